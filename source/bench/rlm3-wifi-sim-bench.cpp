@@ -0,0 +1,245 @@
+#include "Test.hpp"
+#include "rlm3-wifi.h"
+#include "rlm3-task.h"
+#include "rlm3-sim.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+
+static volatile size_t g_receive_bytes;
+static volatile size_t g_callback_count;
+static volatile RLM3_Task g_task;
+
+
+extern void RLM3_WIFI_ReceiveBlock_Callback(size_t link_id, const uint8_t* data, size_t size)
+{
+	g_receive_bytes += size;
+	RLM3_GiveFromISR(g_task);
+}
+
+extern void RLM3_WIFI_NetworkConnect_Callback(size_t link_id, bool local_connection)
+{
+	g_callback_count++;
+}
+
+extern void RLM3_WIFI_NetworkDisconnect_Callback(size_t link_id, bool local_connection)
+{
+	g_callback_count++;
+}
+
+extern void RLM3_WIFI_ReceiveReady_Callback(size_t link_id)
+{
+	// Parses in place and releases everything, wrapped part included.
+	const uint8_t* data;
+	for (size_t size = RLM3_WIFI_ReceiveAcquire(link_id, &data); size > 0; size = RLM3_WIFI_ReceiveAcquire(link_id, &data))
+	{
+		g_receive_bytes += size;
+		RLM3_WIFI_ReceiveRelease(link_id, size);
+	}
+	RLM3_GiveFromISR(g_task);
+}
+
+extern void SIM_WIFI_AT_Receive_Callback(const uint8_t* data, size_t size)
+{
+	g_receive_bytes += size;
+	RLM3_GiveFromISR(g_task);
+}
+
+static void Report(const char* name, size_t ops, size_t bytes_per_op, std::chrono::steady_clock::time_point start)
+{
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	double ns_per_op = ns / ops;
+	std::printf("{\"benchmark\":\"%s\",\"ops\":%zu,\"bytes_per_op\":%zu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.0f}\n", name, ops, bytes_per_op, ns_per_op, 1e9 / ns_per_op);
+}
+
+static void Connect()
+{
+	SIM_WIFI_SetNetwork("bench-ssid", "bench-password");
+	for (size_t i = 0; i < RLM3_WIFI_LINK_COUNT; i++)
+		SIM_WIFI_SetServer(i, "bench-server", "bench-service");
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("bench-ssid", "bench-password");
+	RLM3_WIFI_ServerConnect(0, "bench-server", "bench-service");
+}
+
+TEST_CASE(BENCH_WIFI_Transmit)
+{
+	const size_t count = 100000;
+	static uint8_t buffer[1024];
+	for (size_t i = 0; i < sizeof(buffer); i++)
+		buffer[i] = (uint8_t)i;
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_TransmitRef(0, buffer, sizeof(buffer));
+	Connect();
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+		ASSERT(RLM3_WIFI_Transmit(0, buffer, sizeof(buffer)));
+	Report("transmit_1024", count, sizeof(buffer), start);
+}
+
+TEST_CASE(BENCH_WIFI_Transmit2)
+{
+	const size_t count = 100000;
+	static uint8_t buffer[1024];
+	for (size_t i = 0; i < sizeof(buffer); i++)
+		buffer[i] = (uint8_t)i;
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_TransmitRef(0, buffer, sizeof(buffer));
+	Connect();
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+		ASSERT(RLM3_WIFI_Transmit2(0, buffer, 16, buffer + 16, sizeof(buffer) - 16));
+	Report("transmit2_16_1008", count, sizeof(buffer), start);
+}
+
+TEST_CASE(BENCH_WIFI_TransmitV)
+{
+	const size_t count = 100000;
+	static uint8_t buffer[1024];
+	for (size_t i = 0; i < sizeof(buffer); i++)
+		buffer[i] = (uint8_t)i;
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_TransmitRef(0, buffer, sizeof(buffer));
+	Connect();
+
+	RLM3_WIFI_Segment segments[] = { { buffer, 16 }, { buffer + 16, sizeof(buffer) - 20 }, { buffer + sizeof(buffer) - 4, 4 } };
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+		ASSERT(RLM3_WIFI_TransmitV(0, segments, 3));
+	Report("transmitv_16_1004_4", count, sizeof(buffer), start);
+}
+
+TEST_CASE(BENCH_WIFI_Receive)
+{
+	const size_t count = 100000;
+	static uint8_t buffer[256];
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_ReceiveRef(0, buffer, sizeof(buffer));
+	Connect();
+	g_task = RLM3_GetCurrentTask();
+	g_receive_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (g_receive_bytes < count * sizeof(buffer))
+		RLM3_Take();
+	Report("receive_256", count, sizeof(buffer), start);
+}
+
+TEST_CASE(BENCH_WIFI_ReceiveRing)
+{
+	const size_t count = 100000;
+	static uint8_t buffer[256];
+	static uint8_t ring[1000];
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_ReceiveRef(0, buffer, sizeof(buffer));
+	RLM3_WIFI_SetReceiveRing(0, ring, sizeof(ring));
+	Connect();
+	g_task = RLM3_GetCurrentTask();
+	g_receive_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (g_receive_bytes < count * sizeof(buffer))
+		RLM3_Take();
+	Report("receive_ring_256", count, sizeof(buffer), start);
+}
+
+static size_t GenerateBenchReceive(void* context, uint8_t* buffer, size_t size)
+{
+	size_t& remaining = *(size_t*)context;
+	size_t count = (size < remaining) ? size : remaining;
+	remaining -= count;
+	return count;
+}
+
+TEST_CASE(BENCH_WIFI_ReceiveStream)
+{
+	const size_t count = 100000;
+	size_t remaining = count * 1024;
+	SIM_WIFI_ReceiveStream(0, GenerateBenchReceive, &remaining);
+	Connect();
+	g_task = RLM3_GetCurrentTask();
+	g_receive_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (g_receive_bytes < count * 1024)
+		RLM3_Take();
+	Report("receive_stream_1024", count, 1024, start);
+}
+
+TEST_CASE(BENCH_WIFI_TimedReceive)
+{
+	// Events are scheduled out of order so the heap does real work.
+	const size_t count = 100000;
+	static uint8_t buffer[256];
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_ReceiveBytesAt(0, (RLM3_Time)((i * 7919) % count), buffer, sizeof(buffer));
+	Connect();
+	g_task = RLM3_GetCurrentTask();
+	g_receive_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (g_receive_bytes < count * sizeof(buffer))
+		RLM3_Take();
+	Report("timed_receive_256", count, sizeof(buffer), start);
+}
+
+TEST_CASE(BENCH_WIFI_ATReceive)
+{
+	// Measures the emulated module's +IPD framing, which is the input to the firmware's AT parser.
+	const size_t count = 100000;
+	static uint8_t buffer[256];
+	SIM_WIFI_SetNetwork("bench-ssid", "bench-password");
+	SIM_WIFI_SetServer(0, "bench-server", "80");
+	g_task = RLM3_GetCurrentTask();
+	SIM_WIFI_AT_Start();
+	const char* commands = "ATE0\r\nAT+CWJAP=\"bench-ssid\",\"bench-password\"\r\nAT+CIPSTART=0,\"TCP\",\"bench-server\",80\r\n";
+	SIM_WIFI_AT_Transmit((const uint8_t*)commands, std::strlen(commands));
+	RLM3_Take();
+	for (size_t i = 0; i < count; i++)
+		SIM_WIFI_ReceiveRef(0, buffer, sizeof(buffer));
+	g_receive_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	while (g_receive_bytes < count * (sizeof(buffer) + std::strlen("\r\n+IPD,0,256:")))
+		RLM3_Take();
+	Report("at_receive_256", count, sizeof(buffer), start);
+	SIM_WIFI_AT_Stop();
+}
+
+TEST_CASE(BENCH_WIFI_ConnectChurn)
+{
+	const size_t count = 100000;
+	SIM_WIFI_SetNetwork("bench-ssid", "bench-password");
+	for (size_t i = 0; i < RLM3_WIFI_LINK_COUNT; i++)
+		SIM_WIFI_SetServer(i, "bench-server", "bench-service");
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("bench-ssid", "bench-password");
+	g_callback_count = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t link_id = i % RLM3_WIFI_LINK_COUNT;
+		ASSERT(RLM3_WIFI_ServerConnect(link_id, "bench-server", "bench-service"));
+		RLM3_WIFI_ServerDisconnect(link_id);
+	}
+	Report("connect_disconnect", count, 0, start);
+	ASSERT(g_callback_count == 2 * count);
+}
+
+TEST_CASE(BENCH_WIFI_Interrupt)
+{
+	const size_t count = 100000;
+	g_task = RLM3_GetCurrentTask();
+	g_callback_count = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+		SIM_AddInterrupt([] { g_callback_count++; RLM3_GiveFromISR(g_task); });
+	while (g_callback_count < count)
+		RLM3_Take();
+	Report("interrupt", count, 0, start);
+}
@@ -0,0 +1,377 @@
+#include "rlm3-wifi.h"
+#include "rlm3-wifi-sim.hpp"
+#include "Test.hpp"
+#include "logger.h"
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+
+// Emulates an ESP module running the AT firmware in multiple connection mode.  The firmware's own driver
+// writes commands with SIM_WIFI_AT_Transmit and reads responses from SIM_WIFI_AT_Receive_Callback, and the
+// emulator maps each command onto the same simulated state the RLM3_WIFI_* stubs use.
+
+static const size_t AT_MAX_SEND_SIZE = 2048;
+
+static bool g_is_at_active;
+static bool g_is_at_ready;
+static bool g_is_at_echo;
+static std::string g_at_line;
+static std::vector<uint8_t> g_at_output;
+static std::vector<uint8_t> g_at_flush;
+static bool g_is_at_flush_scheduled;
+static bool g_is_at_flushing;
+static size_t g_at_send_link;
+static size_t g_at_send_remaining;
+static std::vector<uint8_t> g_at_send_buffer;
+static std::string g_at_ap_ssid;
+static std::string g_at_ap_password;
+static size_t g_at_ap_max_clients;
+static std::string g_at_ap_ip_address;
+
+TEST_SETUP(SIM_WIFI_ATInit)
+{
+	g_is_at_active = false;
+	g_is_at_ready = false;
+	g_is_at_echo = true;
+	g_at_line.clear();
+	g_at_output.clear();
+	g_is_at_flush_scheduled = false;
+	g_is_at_flushing = false;
+	g_at_send_remaining = 0;
+	g_at_send_buffer.clear();
+	g_at_ap_ssid.clear();
+	g_at_ap_password.clear();
+	g_at_ap_max_clients = 0;
+	g_at_ap_ip_address.clear();
+}
+
+static void Emit(const char* text)
+{
+	g_at_output.insert(g_at_output.end(), text, text + std::strlen(text));
+}
+
+static void ScheduleFlush();
+
+static void FlushOutput()
+{
+	// The buffer is swapped out first so the driver may transmit from inside the callback.  Output produced
+	// while the callback runs is flushed by a later interrupt.
+	g_is_at_flush_scheduled = false;
+	if (g_at_output.empty())
+		return;
+	if (g_is_at_flushing)
+	{
+		ScheduleFlush();
+		return;
+	}
+	g_is_at_flushing = true;
+	g_at_flush.swap(g_at_output);
+	g_at_output.clear();
+	SIM_WIFI_AT_Receive_Callback(g_at_flush.data(), g_at_flush.size());
+	g_is_at_flushing = false;
+}
+
+static void ScheduleFlush()
+{
+	if (g_is_at_flush_scheduled || g_at_output.empty())
+		return;
+	g_is_at_flush_scheduled = true;
+	SIM_WIFI_AddInterrupt(FlushOutput);
+}
+
+static std::vector<std::string> ParseArguments(const char* text)
+{
+	// Arguments are comma separated.  Quoted strings may contain commas and use backslash escapes.
+	std::vector<std::string> arguments(1);
+	bool is_quoted = false;
+	for (const char* p = text; *p != 0; p++)
+	{
+		if (is_quoted && *p == '\\' && p[1] != 0)
+			arguments.back() += *++p;
+		else if (*p == '"')
+			is_quoted = !is_quoted;
+		else if (!is_quoted && *p == ',')
+			arguments.emplace_back();
+		else
+			arguments.back() += *p;
+	}
+	return arguments;
+}
+
+static bool ParseNumber(const std::string& text, size_t* value)
+{
+	if (text.empty())
+		return false;
+	char* end = nullptr;
+	*value = std::strtoul(text.c_str(), &end, 10);
+	return *end == 0;
+}
+
+static bool ParseLink(const std::string& text, size_t* link_id)
+{
+	return ParseNumber(text, link_id) && *link_id < RLM3_WIFI_LINK_COUNT;
+}
+
+static void FormatVersion(char* buffer, size_t size, const char* name, uint32_t version)
+{
+	std::snprintf(buffer, size, "%s version:%u.%u.%u.%u\r\n", name, (version >> 24) & 0xFF, (version >> 16) & 0xFF, (version >> 8) & 0xFF, version & 0xFF);
+}
+
+static const char* RunVersion()
+{
+	uint32_t at_version;
+	uint32_t sdk_version;
+	if (!SIM_WIFI_ModuleGetVersion(&at_version, &sdk_version))
+		return "\r\nERROR\r\n";
+	char buffer[64];
+	FormatVersion(buffer, sizeof(buffer), "AT", at_version);
+	Emit(buffer);
+	FormatVersion(buffer, sizeof(buffer), "SDK", sdk_version);
+	Emit(buffer);
+	return "\r\nOK\r\n";
+}
+
+static const char* RunReset()
+{
+	Emit("\r\nOK\r\n");
+	SIM_WIFI_ModuleDeinit();
+	g_is_at_echo = true;
+	g_is_at_ready = SIM_WIFI_ModuleInit();
+	return g_is_at_ready ? "\r\nready\r\n" : "";
+}
+
+static const char* RunJoinAccessPoint(const std::vector<std::string>& arguments)
+{
+	if (arguments.size() < 2)
+		return "\r\nERROR\r\n";
+	if (!SIM_WIFI_ModuleNetworkConnect(arguments[0].c_str(), arguments[1].c_str()))
+		return "+CWJAP:3\r\n\r\nFAIL\r\n";
+	return "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n";
+}
+
+static const char* RunQuitAccessPoint()
+{
+	if (SIM_WIFI_ModuleIsNetworkConnected())
+		SIM_WIFI_ModuleNetworkDisconnect();
+	return "\r\nOK\r\nWIFI DISCONNECT\r\n";
+}
+
+static const char* RunSetAccessPoint(const std::vector<std::string>& arguments)
+{
+	if (arguments.size() < 4)
+		return "\r\nERROR\r\n";
+	g_at_ap_ssid = arguments[0];
+	g_at_ap_password = arguments[1];
+	g_at_ap_max_clients = RLM3_WIFI_LINK_COUNT;
+	if (arguments.size() >= 5 && !ParseNumber(arguments[4], &g_at_ap_max_clients))
+		return "\r\nERROR\r\n";
+	return "\r\nOK\r\n";
+}
+
+static const char* RunSetAccessPointAddress(const std::vector<std::string>& arguments)
+{
+	g_at_ap_ip_address = arguments[0];
+	return "\r\nOK\r\n";
+}
+
+static const char* RunServer(const std::vector<std::string>& arguments)
+{
+	if (arguments[0] == "0")
+	{
+		if (SIM_WIFI_ModuleIsLocalNetworkEnabled())
+			SIM_WIFI_ModuleLocalNetworkDisable();
+		return "\r\nOK\r\n";
+	}
+	if (arguments[0] != "1" || arguments.size() < 2)
+		return "\r\nERROR\r\n";
+	if (!SIM_WIFI_ModuleLocalNetworkEnable(g_at_ap_ssid.c_str(), g_at_ap_password.c_str(), g_at_ap_max_clients, g_at_ap_ip_address.c_str(), arguments[1].c_str()))
+		return "\r\nERROR\r\n";
+	return "\r\nOK\r\n";
+}
+
+static const char* RunStart(const std::vector<std::string>& arguments)
+{
+	// The module reports "<link>,CONNECT" through the connect notification before the OK.
+	size_t link_id;
+	if (arguments.size() < 4 || !ParseLink(arguments[0], &link_id) || arguments[1] != "TCP")
+		return "\r\nERROR\r\n";
+	if (SIM_WIFI_ModuleIsServerConnected(link_id))
+		return "ALREADY CONNECTED\r\n\r\nERROR\r\n";
+	if (!SIM_WIFI_ModuleServerConnect(link_id, arguments[2].c_str(), arguments[3].c_str()))
+		return "\r\nERROR\r\nCLOSED\r\n";
+	return "\r\nOK\r\n";
+}
+
+static const char* RunClose(const std::vector<std::string>& arguments)
+{
+	size_t link_id;
+	if (!ParseLink(arguments[0], &link_id) || !SIM_WIFI_ModuleIsServerConnected(link_id))
+		return "\r\nERROR\r\n";
+	SIM_WIFI_ModuleServerDisconnect(link_id);
+	return "\r\nOK\r\n";
+}
+
+static const char* RunSend(const std::vector<std::string>& arguments)
+{
+	size_t link_id;
+	size_t size;
+	if (arguments.size() < 2 || !ParseLink(arguments[0], &link_id) || !ParseNumber(arguments[1], &size) || size == 0 || size > AT_MAX_SEND_SIZE)
+		return "\r\nERROR\r\n";
+	if (!SIM_WIFI_ModuleIsServerConnected(link_id))
+		return "link is not valid\r\n\r\nERROR\r\n";
+	g_at_send_link = link_id;
+	g_at_send_remaining = size;
+	g_at_send_buffer.clear();
+	return "\r\nOK\r\n> ";
+}
+
+static void CompleteSend()
+{
+	// The simulator accepts at most 1024 bytes per transmit, so larger sends are split.
+	bool is_sent = true;
+	for (size_t offset = 0; is_sent && offset < g_at_send_buffer.size(); offset += 1024)
+		is_sent = SIM_WIFI_ModuleTransmit(g_at_send_link, g_at_send_buffer.data() + offset, std::min<size_t>(1024, g_at_send_buffer.size() - offset));
+	if (!is_sent)
+	{
+		Emit("\r\nSEND FAIL\r\n");
+		return;
+	}
+	char buffer[48];
+	std::snprintf(buffer, sizeof(buffer), "\r\nRecv %zu bytes\r\n\r\nSEND OK\r\n", g_at_send_buffer.size());
+	Emit(buffer);
+}
+
+static const char* RunCommand(const char* command)
+{
+	if (std::strcmp(command, "AT") == 0)
+		return "\r\nOK\r\n";
+	if (std::strcmp(command, "ATE0") == 0 || std::strcmp(command, "ATE1") == 0)
+	{
+		g_is_at_echo = (command[3] == '1');
+		return "\r\nOK\r\n";
+	}
+	if (std::strcmp(command, "AT+GMR") == 0)
+		return RunVersion();
+	if (std::strcmp(command, "AT+RST") == 0)
+		return RunReset();
+	if (std::strcmp(command, "AT+CWQAP") == 0)
+		return RunQuitAccessPoint();
+
+	const char* separator = std::strchr(command, '=');
+	if (separator == nullptr)
+		return "\r\nERROR\r\n";
+	std::string name(command, separator);
+	auto arguments = ParseArguments(separator + 1);
+	if (name == "AT+CWMODE" || name == "AT+CIPMUX")
+		return "\r\nOK\r\n";
+	if (name == "AT+CWJAP")
+		return RunJoinAccessPoint(arguments);
+	if (name == "AT+CWSAP")
+		return RunSetAccessPoint(arguments);
+	if (name == "AT+CIPAP")
+		return RunSetAccessPointAddress(arguments);
+	if (name == "AT+CIPSERVER")
+		return RunServer(arguments);
+	if (name == "AT+CIPSTART")
+		return RunStart(arguments);
+	if (name == "AT+CIPCLOSE")
+		return RunClose(arguments);
+	if (name == "AT+CIPSEND")
+		return RunSend(arguments);
+	LOG_ERROR("WIFI AT unsupported command %s", command);
+	return "\r\nERROR\r\n";
+}
+
+extern void SIM_WIFI_AT_Start()
+{
+	ASSERT(!g_is_at_active);
+	g_is_at_active = true;
+	g_is_at_echo = true;
+	g_is_at_ready = SIM_WIFI_ModuleInit();
+	if (g_is_at_ready)
+		Emit("\r\nready\r\n");
+	ScheduleFlush();
+}
+
+extern void SIM_WIFI_AT_Stop()
+{
+	if (!g_is_at_active)
+		return;
+	if (g_is_at_ready)
+		SIM_WIFI_ModuleDeinit();
+	g_is_at_active = false;
+	g_is_at_ready = false;
+	g_at_line.clear();
+	g_at_output.clear();
+	g_at_send_remaining = 0;
+}
+
+extern void SIM_WIFI_AT_Transmit(const uint8_t* data, size_t size)
+{
+	ASSERT(g_is_at_active);
+	const uint8_t* end = data + size;
+	while (g_is_at_ready && data < end)
+	{
+		if (g_at_send_remaining > 0)
+		{
+			size_t count = std::min<size_t>(g_at_send_remaining, end - data);
+			g_at_send_buffer.insert(g_at_send_buffer.end(), data, data + count);
+			g_at_send_remaining -= count;
+			data += count;
+			if (g_at_send_remaining == 0)
+				CompleteSend();
+			continue;
+		}
+		uint8_t c = *data++;
+		if (g_is_at_echo)
+			g_at_output.push_back(c);
+		g_at_line += (char)c;
+		if (g_at_line.size() >= 2 && g_at_line.compare(g_at_line.size() - 2, 2, "\r\n") == 0)
+		{
+			g_at_line.resize(g_at_line.size() - 2);
+			if (!g_at_line.empty())
+				Emit(RunCommand(g_at_line.c_str()));
+			g_at_line.clear();
+		}
+	}
+	ScheduleFlush();
+}
+
+extern bool SIM_WIFI_AT_IsActive()
+{
+	return g_is_at_active;
+}
+
+extern void SIM_WIFI_AT_NotifyReceive(size_t link_id, const uint8_t* data, size_t size)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "\r\n+IPD,%zu,%zu:", link_id, size);
+	Emit(buffer);
+	g_at_output.insert(g_at_output.end(), data, data + size);
+	FlushOutput();
+}
+
+extern void SIM_WIFI_AT_NotifyConnect(size_t link_id)
+{
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "%zu,CONNECT\r\n", link_id);
+	Emit(buffer);
+	FlushOutput();
+}
+
+extern void SIM_WIFI_AT_NotifyDisconnect(size_t link_id)
+{
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "%zu,CLOSED\r\n", link_id);
+	Emit(buffer);
+	FlushOutput();
+}
+
+extern __attribute__((weak)) void SIM_WIFI_AT_Receive_Callback(const uint8_t* data, size_t size)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
@@ -0,0 +1,243 @@
+#include "rlm3-wifi.h"
+#include "rlm3-wifi-sim-capture.hpp"
+#include "Test.hpp"
+#include "logger.h"
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+
+
+static std::FILE* g_capture_file = nullptr;
+static std::vector<char> g_capture_file_buffer;
+static std::mutex g_capture_mutex;
+
+TEST_SETUP(SIM_WIFI_CaptureInit)
+{
+	SIM_WIFI_StopCapture();
+}
+
+static void Put16(uint8_t* cursor, uint16_t value)
+{
+	cursor[0] = (uint8_t)value;
+	cursor[1] = (uint8_t)(value >> 8);
+}
+
+static void Put32(uint8_t* cursor, uint32_t value)
+{
+	Put16(cursor, (uint16_t)value);
+	Put16(cursor + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t Get16(const uint8_t* cursor)
+{
+	return (uint16_t)(cursor[0] | (cursor[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* cursor)
+{
+	return Get16(cursor) | ((uint32_t)Get16(cursor + 2) << 16);
+}
+
+static void Put16BE(uint8_t* cursor, uint16_t value)
+{
+	cursor[0] = (uint8_t)(value >> 8);
+	cursor[1] = (uint8_t)value;
+}
+
+static void Put32BE(uint8_t* cursor, uint32_t value)
+{
+	Put16BE(cursor, (uint16_t)(value >> 16));
+	Put16BE(cursor + 2, (uint16_t)value);
+}
+
+extern void SIM_WIFI_CaptureEvent(SIM_WIFI_CaptureType type, size_t link_id, uint8_t flags, const RLM3_WIFI_Segment* segments, size_t segment_count)
+{
+	std::lock_guard<std::mutex> lock(g_capture_mutex);
+	if (g_capture_file == nullptr)
+		return;
+	size_t size = 0;
+	for (size_t i = 0; i < segment_count; i++)
+		size += segments[i].size;
+	uint8_t header[12];
+	Put32(header + 0, RLM3_GetCurrentTime());
+	header[4] = type;
+	header[5] = flags;
+	Put16(header + 6, (uint16_t)link_id);
+	Put32(header + 8, (uint32_t)size);
+	std::fwrite(header, sizeof(header), 1, g_capture_file);
+	for (size_t i = 0; i < segment_count; i++)
+		if (segments[i].size > 0)
+			std::fwrite(segments[i].data, segments[i].size, 1, g_capture_file);
+}
+
+extern bool SIM_WIFI_ReadCaptureFileHeader(std::FILE* file)
+{
+	uint8_t header[12];
+	if (std::fread(header, sizeof(header), 1, file) != 1)
+		return false;
+	return std::memcmp(header, SIM_WIFI_CAPTURE_MAGIC, 8) == 0 && Get32(header + 8) == SIM_WIFI_CAPTURE_VERSION;
+}
+
+extern bool SIM_WIFI_ReadCaptureHeader(std::FILE* file, SIM_WIFI_CaptureHeader* header)
+{
+	uint8_t buffer[12];
+	if (std::fread(buffer, sizeof(buffer), 1, file) != 1)
+		return false;
+	header->time = Get32(buffer + 0);
+	header->type = (SIM_WIFI_CaptureType)buffer[4];
+	header->flags = buffer[5];
+	header->link_id = Get16(buffer + 6);
+	header->size = Get32(buffer + 8);
+	return true;
+}
+
+extern bool SIM_WIFI_StartCapture(const char* path)
+{
+	SIM_WIFI_StopCapture();
+	std::lock_guard<std::mutex> lock(g_capture_mutex);
+	g_capture_file = std::fopen(path, "wb");
+	if (g_capture_file == nullptr)
+	{
+		LOG_ERROR("WIFI capture open %s failed", path);
+		return false;
+	}
+	// A large stdio buffer keeps the per-event cost to a memcpy at high throughput.
+	g_capture_file_buffer.resize(1 << 20);
+	std::setvbuf(g_capture_file, g_capture_file_buffer.data(), _IOFBF, g_capture_file_buffer.size());
+	uint8_t header[12];
+	std::memcpy(header, SIM_WIFI_CAPTURE_MAGIC, 8);
+	Put32(header + 8, SIM_WIFI_CAPTURE_VERSION);
+	std::fwrite(header, sizeof(header), 1, g_capture_file);
+	return true;
+}
+
+extern void SIM_WIFI_StopCapture()
+{
+	std::lock_guard<std::mutex> lock(g_capture_mutex);
+	if (g_capture_file != nullptr)
+		std::fclose(g_capture_file);
+	g_capture_file = nullptr;
+}
+
+struct PcapStream
+{
+	bool is_open;
+	uint32_t device_sequence;
+	uint32_t remote_sequence;
+};
+
+static void WritePcapPacket(std::FILE* out, RLM3_Time time, size_t link_id, PcapStream& stream, bool from_device, uint8_t tcp_flags, const uint8_t* data, size_t size)
+{
+	// Each link is shown as a TCP stream between 10.0.0.1 (device) and 10.0.0.2 (remote).  Checksums are left zero.
+	uint8_t packet[40];
+	std::memset(packet, 0, sizeof(packet));
+	packet[0] = 0x45;
+	Put16BE(packet + 2, (uint16_t)(sizeof(packet) + size));
+	packet[8] = 64;
+	packet[9] = 6;
+	uint32_t device_address = 0x0A000001;
+	uint32_t remote_address = 0x0A000002;
+	uint16_t device_port = (uint16_t)(49152 + link_id);
+	uint16_t remote_port = 80;
+	Put32BE(packet + 12, from_device ? device_address : remote_address);
+	Put32BE(packet + 16, from_device ? remote_address : device_address);
+	uint8_t* tcp = packet + 20;
+	Put16BE(tcp + 0, from_device ? device_port : remote_port);
+	Put16BE(tcp + 2, from_device ? remote_port : device_port);
+	uint32_t& sequence = from_device ? stream.device_sequence : stream.remote_sequence;
+	uint32_t& acknowledge = from_device ? stream.remote_sequence : stream.device_sequence;
+	Put32BE(tcp + 4, sequence);
+	Put32BE(tcp + 8, acknowledge);
+	tcp[12] = 5 << 4;
+	tcp[13] = tcp_flags;
+	Put16BE(tcp + 14, 65535);
+	sequence += (uint32_t)size + (((tcp_flags & 0x03) != 0) ? 1 : 0);
+
+	uint8_t record[16];
+	Put32(record + 0, time / 1000);
+	Put32(record + 4, (time % 1000) * 1000);
+	Put32(record + 8, (uint32_t)(sizeof(packet) + size));
+	Put32(record + 12, (uint32_t)(sizeof(packet) + size));
+	std::fwrite(record, sizeof(record), 1, out);
+	std::fwrite(packet, sizeof(packet), 1, out);
+	if (size > 0)
+		std::fwrite(data, size, 1, out);
+}
+
+extern bool SIM_WIFI_ConvertCaptureToPcap(const char* capture_path, const char* pcap_path)
+{
+	std::FILE* in = std::fopen(capture_path, "rb");
+	if (in == nullptr)
+		return false;
+	if (!SIM_WIFI_ReadCaptureFileHeader(in))
+	{
+		std::fclose(in);
+		return false;
+	}
+	std::FILE* out = std::fopen(pcap_path, "wb");
+	if (out == nullptr)
+	{
+		std::fclose(in);
+		return false;
+	}
+
+	uint8_t header[24];
+	Put32(header + 0, 0xA1B2C3D4);
+	Put16(header + 4, 2);
+	Put16(header + 6, 4);
+	Put32(header + 8, 0);
+	Put32(header + 12, 0);
+	Put32(header + 16, 65535);
+	Put32(header + 20, 228); // LINKTYPE_IPV4
+	std::fwrite(header, sizeof(header), 1, out);
+
+	const uint8_t TCP_FIN = 0x01;
+	const uint8_t TCP_SYN = 0x02;
+	const uint8_t TCP_PSH_ACK = 0x18;
+	const uint8_t TCP_ACK = 0x10;
+	const size_t SEGMENT_SIZE = 1460;
+
+	std::vector<PcapStream> streams;
+	std::vector<uint8_t> data;
+	SIM_WIFI_CaptureHeader record;
+	bool is_valid = true;
+	while (SIM_WIFI_ReadCaptureHeader(in, &record))
+	{
+		data.resize(record.size);
+		if (record.size > 0 && std::fread(data.data(), record.size, 1, in) != 1)
+		{
+			is_valid = false;
+			break;
+		}
+		if (record.link_id >= streams.size())
+			streams.resize(record.link_id + 1, { false, 0, 0 });
+		auto& stream = streams[record.link_id];
+		bool is_local = (record.flags & SIM_WIFI_CAPTURE_FLAG_LOCAL) != 0;
+		switch (record.type)
+		{
+		case SIM_WIFI_CAPTURE_TRANSMIT:
+		case SIM_WIFI_CAPTURE_RECEIVE:
+			for (size_t offset = 0; offset < data.size(); offset += SEGMENT_SIZE)
+				WritePcapPacket(out, record.time, record.link_id, stream, record.type == SIM_WIFI_CAPTURE_TRANSMIT, TCP_PSH_ACK, data.data() + offset, std::min(SEGMENT_SIZE, data.size() - offset));
+			break;
+		case SIM_WIFI_CAPTURE_CONNECT:
+			stream = { true, 0, 0 };
+			WritePcapPacket(out, record.time, record.link_id, stream, !is_local, TCP_SYN, nullptr, 0);
+			WritePcapPacket(out, record.time, record.link_id, stream, is_local, TCP_SYN | TCP_ACK, nullptr, 0);
+			break;
+		case SIM_WIFI_CAPTURE_DISCONNECT:
+			if (stream.is_open)
+				WritePcapPacket(out, record.time, record.link_id, stream, true, TCP_FIN | TCP_ACK, nullptr, 0);
+			stream.is_open = false;
+			break;
+		default:
+			// Network up and down events have no TCP equivalent.
+			break;
+		}
+	}
+
+	std::fclose(in);
+	std::fclose(out);
+	return is_valid;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "rlm3-wifi.h"
+#include <cstdio>
+
+
+// Capture files start with an 8 byte magic and a 32 bit version, followed by records.  Each record
+// is a 12 byte little-endian header (time, type, flags, link id, size) followed by size bytes of data.
+
+#define SIM_WIFI_CAPTURE_MAGIC "RLM3WCAP"
+#define SIM_WIFI_CAPTURE_VERSION (1)
+#define SIM_WIFI_CAPTURE_FLAG_LOCAL (0x01)
+#define SIM_WIFI_CAPTURE_FLAG_REMOTE (0x02)
+
+enum SIM_WIFI_CaptureType : uint8_t
+{
+	SIM_WIFI_CAPTURE_TRANSMIT = 1,
+	SIM_WIFI_CAPTURE_RECEIVE = 2,
+	SIM_WIFI_CAPTURE_CONNECT = 3,
+	SIM_WIFI_CAPTURE_DISCONNECT = 4,
+	SIM_WIFI_CAPTURE_NETWORK_UP = 5,
+	SIM_WIFI_CAPTURE_NETWORK_DOWN = 6,
+};
+
+struct SIM_WIFI_CaptureHeader
+{
+	RLM3_Time time;
+	SIM_WIFI_CaptureType type;
+	uint8_t flags;
+	uint16_t link_id;
+	uint32_t size;
+};
+
+inline uint8_t SIM_WIFI_CaptureFlags(bool local, bool remote = false)
+{
+	// Remote events were initiated by the peer rather than by the firmware under test.
+	return (local ? SIM_WIFI_CAPTURE_FLAG_LOCAL : 0) | (remote ? SIM_WIFI_CAPTURE_FLAG_REMOTE : 0);
+}
+
+extern void SIM_WIFI_CaptureEvent(SIM_WIFI_CaptureType type, size_t link_id, uint8_t flags, const RLM3_WIFI_Segment* segments = nullptr, size_t segment_count = 0);
+
+inline void SIM_WIFI_CaptureEvent(SIM_WIFI_CaptureType type, size_t link_id, uint8_t flags, const uint8_t* data, size_t size)
+{
+	RLM3_WIFI_Segment segment = { data, size };
+	SIM_WIFI_CaptureEvent(type, link_id, flags, &segment, 1);
+}
+
+extern bool SIM_WIFI_ReadCaptureFileHeader(std::FILE* file);
+extern bool SIM_WIFI_ReadCaptureHeader(std::FILE* file, SIM_WIFI_CaptureHeader* header);
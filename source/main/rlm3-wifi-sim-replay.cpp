@@ -0,0 +1,134 @@
+#include "rlm3-wifi.h"
+#include "rlm3-wifi-sim.hpp"
+#include "rlm3-wifi-sim-capture.hpp"
+#include "Test.hpp"
+#include "logger.h"
+#include <vector>
+
+
+static std::FILE* g_replay_file = nullptr;
+static bool g_replay_original_timing;
+static bool g_has_replay_event;
+static SIM_WIFI_CaptureHeader g_replay_event;
+static std::vector<uint8_t> g_replay_data;
+static RLM3_Time g_replay_time;
+// Queued events carry the generation they were scheduled in, so a stop or restart orphans the old chain.
+static uint32_t g_replay_generation;
+
+TEST_SETUP(SIM_WIFI_ReplayInit)
+{
+	SIM_WIFI_StopReplay();
+}
+
+static bool IsInjectedEvent(const SIM_WIFI_CaptureHeader& header)
+{
+	// Remote events are driven by the replay.  Everything else was initiated by the firmware, which is
+	// expected to repeat it; recorded transmits become transmit expectations.
+	if (header.type == SIM_WIFI_CAPTURE_RECEIVE)
+		return true;
+	if (header.type == SIM_WIFI_CAPTURE_CONNECT || header.type == SIM_WIFI_CAPTURE_DISCONNECT)
+		return (header.flags & SIM_WIFI_CAPTURE_FLAG_REMOTE) != 0;
+	return false;
+}
+
+static bool ReadReplayRecord()
+{
+	if (!SIM_WIFI_ReadCaptureHeader(g_replay_file, &g_replay_event))
+		return false;
+	g_replay_data.resize(g_replay_event.size);
+	if (g_replay_event.size > 0 && std::fread(g_replay_data.data(), g_replay_event.size, 1, g_replay_file) != 1)
+	{
+		LOG_ERROR("WIFI replay truncated record");
+		return false;
+	}
+	return true;
+}
+
+static void ReadAheadReplay()
+{
+	// Queue every transmit the firmware should make before the next injected event, then hold that event.
+	g_has_replay_event = false;
+	while (ReadReplayRecord())
+	{
+		if (IsInjectedEvent(g_replay_event))
+		{
+			g_has_replay_event = true;
+			return;
+		}
+		if (g_replay_event.type == SIM_WIFI_CAPTURE_TRANSMIT && g_replay_event.size > 0)
+			SIM_WIFI_TransmitBytes(g_replay_event.link_id, g_replay_data.data(), g_replay_data.size());
+	}
+}
+
+static void RunReplayEvent(uint32_t generation);
+
+static void ScheduleReplayEvent()
+{
+	if (!g_has_replay_event)
+		return;
+	uint32_t generation = g_replay_generation;
+	auto run = [generation]() { RunReplayEvent(generation); };
+	if (g_replay_original_timing && g_replay_event.time > g_replay_time)
+		SIM_WIFI_AddTimer(RLM3_GetCurrentTime() + g_replay_event.time - g_replay_time, run);
+	else
+		SIM_WIFI_AddInterrupt(run);
+	g_replay_time = g_replay_event.time;
+}
+
+static void RunReplayEvent(uint32_t generation)
+{
+	if (generation != g_replay_generation || g_replay_file == nullptr || !g_has_replay_event)
+		return;
+	size_t link_id = g_replay_event.link_id;
+	switch (g_replay_event.type)
+	{
+	case SIM_WIFI_CAPTURE_RECEIVE:
+		SIM_WIFI_DeliverReceive(link_id, g_replay_data.data(), g_replay_data.size());
+		break;
+	case SIM_WIFI_CAPTURE_CONNECT:
+		SIM_WIFI_DeliverConnect(link_id);
+		break;
+	case SIM_WIFI_CAPTURE_DISCONNECT:
+		SIM_WIFI_DeliverDisconnect(link_id);
+		break;
+	default:
+		break;
+	}
+	ReadAheadReplay();
+	ScheduleReplayEvent();
+}
+
+extern bool SIM_WIFI_StartReplay(const char* path, bool original_timing)
+{
+	SIM_WIFI_StopReplay();
+	g_replay_file = std::fopen(path, "rb");
+	if (g_replay_file == nullptr)
+		return false;
+	if (!SIM_WIFI_ReadCaptureFileHeader(g_replay_file))
+	{
+		SIM_WIFI_StopReplay();
+		return false;
+	}
+	g_replay_original_timing = original_timing;
+	g_replay_time = 0;
+	ReadAheadReplay();
+	if (g_has_replay_event)
+		g_replay_time = g_replay_event.time;
+	ScheduleReplayEvent();
+	return true;
+}
+
+extern void SIM_WIFI_StopReplay()
+{
+	if (g_replay_file != nullptr)
+		std::fclose(g_replay_file);
+	g_replay_file = nullptr;
+	g_has_replay_event = false;
+	g_replay_generation++;
+	g_replay_data.clear();
+}
+
+extern bool SIM_WIFI_IsReplayActive()
+{
+	return g_replay_file != nullptr && g_has_replay_event;
+}
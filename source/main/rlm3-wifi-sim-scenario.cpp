@@ -0,0 +1,504 @@
+#include "rlm3-wifi.h"
+#include "rlm3-wifi-sim.hpp"
+#include "Test.hpp"
+#include "logger.h"
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+
+
+// Text scenarios have one command per line; blank lines and lines starting with '#' are ignored.
+//
+//   network <ssid> <password>
+//   local-network <ssid> <password> <max clients> <ip address> <service>
+//   server <link> <server> <service>
+//   transmit <link> <data>
+//   receive <link> <data>
+//   connect <link>
+//   disconnect <link>
+//   wait <milliseconds>
+//
+// Data runs to the end of the line and accepts \n, \r, \t, \\ and \xHH escapes.  Compiled scenarios start
+// with an 8 byte magic, a 32 bit version, the event count and the data size, followed by 16 byte
+// little-endian event records (op, reserved, link id, value, data offset, data size) and the data block.
+
+#define SIM_WIFI_SCENARIO_MAGIC "RLM3WSCN"
+#define SIM_WIFI_SCENARIO_VERSION (1)
+
+enum ScenarioOp : uint8_t
+{
+	SCENARIO_NETWORK = 1,
+	SCENARIO_LOCAL_NETWORK = 2,
+	SCENARIO_SERVER = 3,
+	SCENARIO_TRANSMIT = 4,
+	SCENARIO_RECEIVE = 5,
+	SCENARIO_CONNECT = 6,
+	SCENARIO_DISCONNECT = 7,
+	SCENARIO_WAIT = 8,
+};
+
+struct ScenarioEvent
+{
+	ScenarioOp op;
+	uint16_t link_id;
+	uint32_t value;
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct Scenario
+{
+	// Every payload and setup string lives in one data block that events index into, so payloads are
+	// scripted without copying them.  Setup strings are stored back to back, each terminated with a zero.
+	std::vector<ScenarioEvent> events;
+	std::vector<uint8_t> data;
+};
+
+// The running scenario's data is shared with the expectations and receives it scripted, so it outlives a
+// stop or restart.  Queued events carry the generation they were scheduled in, so a stop orphans the old chain.
+static std::vector<ScenarioEvent> g_scenario_events;
+static std::shared_ptr<const std::vector<uint8_t>> g_scenario_data;
+static size_t g_scenario_cursor;
+static bool g_is_scenario_active;
+static uint32_t g_scenario_generation;
+
+TEST_SETUP(SIM_WIFI_ScenarioInit)
+{
+	SIM_WIFI_StopScenario();
+	g_scenario_events.clear();
+	g_scenario_data = nullptr;
+}
+
+static void Put16(uint8_t* cursor, uint16_t value)
+{
+	cursor[0] = (uint8_t)value;
+	cursor[1] = (uint8_t)(value >> 8);
+}
+
+static void Put32(uint8_t* cursor, uint32_t value)
+{
+	Put16(cursor, (uint16_t)value);
+	Put16(cursor + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t Get16(const uint8_t* cursor)
+{
+	return (uint16_t)(cursor[0] | (cursor[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t* cursor)
+{
+	return Get16(cursor) | ((uint32_t)Get16(cursor + 2) << 16);
+}
+
+static size_t GetStringCount(ScenarioOp op)
+{
+	switch (op)
+	{
+	case SCENARIO_NETWORK:
+		return 2;
+	case SCENARIO_LOCAL_NETWORK:
+		return 4;
+	case SCENARIO_SERVER:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static bool IsLinkEvent(ScenarioOp op)
+{
+	return op == SCENARIO_SERVER || op == SCENARIO_TRANSMIT || op == SCENARIO_RECEIVE || op == SCENARIO_CONNECT || op == SCENARIO_DISCONNECT;
+}
+
+static bool IsInjectedEvent(ScenarioOp op)
+{
+	// Injected events wait their turn on the simulator clock.  Setup and transmit expectations are applied
+	// as soon as the scenario reaches them so the firmware may answer the event before them.
+	return op == SCENARIO_RECEIVE || op == SCENARIO_CONNECT || op == SCENARIO_DISCONNECT || op == SCENARIO_WAIT;
+}
+
+static bool ValidateScenario(const Scenario& scenario)
+{
+	for (size_t i = 0; i < scenario.events.size(); i++)
+	{
+		const ScenarioEvent& e = scenario.events[i];
+		if (e.op < SCENARIO_NETWORK || e.op > SCENARIO_WAIT)
+		{
+			LOG_ERROR("WIFI scenario event %zu has unknown op %u", i, e.op);
+			return false;
+		}
+		if (IsLinkEvent(e.op) && e.link_id >= RLM3_WIFI_LINK_COUNT)
+		{
+			LOG_ERROR("WIFI scenario event %zu has invalid link %u", i, e.link_id);
+			return false;
+		}
+		if (e.offset > scenario.data.size() || e.size > scenario.data.size() - e.offset)
+		{
+			LOG_ERROR("WIFI scenario event %zu data is out of range", i);
+			return false;
+		}
+		if ((e.op == SCENARIO_TRANSMIT || e.op == SCENARIO_RECEIVE) && (e.size == 0 || e.size > 1024))
+		{
+			LOG_ERROR("WIFI scenario event %zu data size %u is not 1 to 1024 bytes", i, e.size);
+			return false;
+		}
+		const uint8_t* strings = scenario.data.data() + e.offset;
+		size_t terminators = 0;
+		for (size_t j = 0; j < e.size; j++)
+			if (strings[j] == 0)
+				terminators++;
+		if (GetStringCount(e.op) > 0 && (terminators != GetStringCount(e.op) || strings[e.size - 1] != 0))
+		{
+			LOG_ERROR("WIFI scenario event %zu has malformed strings", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool ParseNumber(const std::string& token, uint32_t* value)
+{
+	if (token.empty())
+		return false;
+	char* end = nullptr;
+	unsigned long result = std::strtoul(token.c_str(), &end, 10);
+	if (*end != 0 || result > 0xFFFFFFFF)
+		return false;
+	*value = (uint32_t)result;
+	return true;
+}
+
+static bool ParseData(const std::string& text, std::vector<uint8_t>& data)
+{
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] != '\\')
+		{
+			data.push_back((uint8_t)text[i]);
+			continue;
+		}
+		if (++i == text.size())
+			return false;
+		switch (text[i])
+		{
+		case 'n': data.push_back('\n'); break;
+		case 'r': data.push_back('\r'); break;
+		case 't': data.push_back('\t'); break;
+		case '\\': data.push_back('\\'); break;
+		case 'x':
+			{
+				if (i + 2 >= text.size())
+					return false;
+				std::string hex = text.substr(i + 1, 2);
+				char* end = nullptr;
+				unsigned long value = std::strtoul(hex.c_str(), &end, 16);
+				if (*end != 0)
+					return false;
+				data.push_back((uint8_t)value);
+				i += 2;
+				break;
+			}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool ParseScenarioLine(const std::string& line, Scenario& scenario)
+{
+	std::vector<std::string> tokens;
+	size_t position = 0;
+	while (position < line.size())
+	{
+		size_t start = line.find_first_not_of(' ', position);
+		if (start == std::string::npos)
+			break;
+		// Data is the rest of the line after the link, spaces included.
+		if (tokens.size() == 2 && (tokens[0] == "transmit" || tokens[0] == "receive"))
+		{
+			tokens.push_back(line.substr(start));
+			break;
+		}
+		size_t end = line.find(' ', start);
+		if (end == std::string::npos)
+			end = line.size();
+		tokens.push_back(line.substr(start, end - start));
+		position = end;
+	}
+	if (tokens.empty() || tokens[0][0] == '#')
+		return true;
+
+	ScenarioEvent e = {};
+	std::vector<std::string> strings;
+	const std::string& command = tokens[0];
+	if (command == "network" && tokens.size() == 3)
+	{
+		e.op = SCENARIO_NETWORK;
+		strings.assign(tokens.begin() + 1, tokens.end());
+	}
+	else if (command == "local-network" && tokens.size() == 6 && ParseNumber(tokens[3], &e.value))
+	{
+		e.op = SCENARIO_LOCAL_NETWORK;
+		strings = { tokens[1], tokens[2], tokens[4], tokens[5] };
+	}
+	else if (command == "wait" && tokens.size() == 2 && ParseNumber(tokens[1], &e.value))
+	{
+		e.op = SCENARIO_WAIT;
+	}
+	else
+	{
+		uint32_t link_id = 0;
+		if (tokens.size() < 2 || !ParseNumber(tokens[1], &link_id) || link_id >= RLM3_WIFI_LINK_COUNT)
+			return false;
+		e.link_id = (uint16_t)link_id;
+		if (command == "server" && tokens.size() == 4)
+			e.op = SCENARIO_SERVER;
+		else if (command == "transmit" && tokens.size() == 3)
+			e.op = SCENARIO_TRANSMIT;
+		else if (command == "receive" && tokens.size() == 3)
+			e.op = SCENARIO_RECEIVE;
+		else if (command == "connect" && tokens.size() == 2)
+			e.op = SCENARIO_CONNECT;
+		else if (command == "disconnect" && tokens.size() == 2)
+			e.op = SCENARIO_DISCONNECT;
+		else
+			return false;
+		if (e.op == SCENARIO_SERVER)
+			strings.assign(tokens.begin() + 2, tokens.end());
+	}
+
+	e.offset = (uint32_t)scenario.data.size();
+	if (e.op == SCENARIO_TRANSMIT || e.op == SCENARIO_RECEIVE)
+	{
+		if (!ParseData(tokens[2], scenario.data))
+			return false;
+	}
+	for (const auto& s : strings)
+		scenario.data.insert(scenario.data.end(), s.c_str(), s.c_str() + s.size() + 1);
+	e.size = (uint32_t)(scenario.data.size() - e.offset);
+	scenario.events.push_back(e);
+	return true;
+}
+
+static bool ParseScenarioText(std::FILE* file, Scenario& scenario)
+{
+	std::string line;
+	size_t line_number = 1;
+	for (int c = std::fgetc(file); ; c = std::fgetc(file))
+	{
+		if (c != '\n' && c != EOF)
+		{
+			if (c != '\r')
+				line.push_back((char)c);
+			continue;
+		}
+		if (!ParseScenarioLine(line, scenario))
+		{
+			LOG_ERROR("WIFI scenario line %zu is invalid: %s", line_number, line.c_str());
+			return false;
+		}
+		if (c == EOF)
+			return true;
+		line.clear();
+		line_number++;
+	}
+}
+
+static bool GetRemainingSize(std::FILE* file, uint64_t* size)
+{
+	long position = std::ftell(file);
+	if (position < 0 || std::fseek(file, 0, SEEK_END) != 0)
+		return false;
+	long end = std::ftell(file);
+	if (end < position || std::fseek(file, position, SEEK_SET) != 0)
+		return false;
+	*size = (uint64_t)(end - position);
+	return true;
+}
+
+static bool ReadScenarioBinary(std::FILE* file, Scenario& scenario)
+{
+	uint8_t header[12];
+	if (std::fread(header, sizeof(header), 1, file) != 1 || Get32(header) != SIM_WIFI_SCENARIO_VERSION)
+	{
+		LOG_ERROR("WIFI scenario has an unsupported version");
+		return false;
+	}
+	uint32_t event_count = Get32(header + 4);
+	uint32_t data_size = Get32(header + 8);
+	// The counts come from the file, so check them against what the file holds before allocating for them.
+	uint64_t remaining = 0;
+	if (!GetRemainingSize(file, &remaining) || (uint64_t)event_count * 16 + data_size > remaining)
+	{
+		LOG_ERROR("WIFI scenario is truncated");
+		return false;
+	}
+	std::vector<uint8_t> records((size_t)event_count * 16);
+	scenario.data.resize(data_size);
+	if ((!records.empty() && std::fread(records.data(), records.size(), 1, file) != 1) ||
+			(data_size > 0 && std::fread(scenario.data.data(), data_size, 1, file) != 1))
+	{
+		LOG_ERROR("WIFI scenario is truncated");
+		return false;
+	}
+	scenario.events.resize(event_count);
+	for (size_t i = 0; i < event_count; i++)
+	{
+		const uint8_t* record = records.data() + i * 16;
+		scenario.events[i] = { (ScenarioOp)record[0], Get16(record + 2), Get32(record + 4), Get32(record + 8), Get32(record + 12) };
+	}
+	return true;
+}
+
+static bool LoadScenario(const char* path, Scenario& scenario)
+{
+	std::FILE* file = std::fopen(path, "rb");
+	if (file == nullptr)
+	{
+		LOG_ERROR("WIFI scenario %s could not be opened: %s", path, std::strerror(errno));
+		return false;
+	}
+	char magic[8];
+	bool is_binary = (std::fread(magic, sizeof(magic), 1, file) == 1 && std::memcmp(magic, SIM_WIFI_SCENARIO_MAGIC, sizeof(magic)) == 0);
+	if (!is_binary)
+		std::rewind(file);
+	bool result = is_binary ? ReadScenarioBinary(file, scenario) : ParseScenarioText(file, scenario);
+	std::fclose(file);
+	return result && ValidateScenario(scenario);
+}
+
+static const char* NextString(const char* s)
+{
+	return s + std::strlen(s) + 1;
+}
+
+static void ApplyScenarioEvent(const ScenarioEvent& e)
+{
+	const uint8_t* data = g_scenario_data->data() + e.offset;
+	const char* strings = (const char*)data;
+	switch (e.op)
+	{
+	case SCENARIO_NETWORK:
+		SIM_WIFI_SetNetwork(strings, NextString(strings));
+		break;
+	case SCENARIO_LOCAL_NETWORK:
+		{
+			const char* password = NextString(strings);
+			const char* ip_address = NextString(password);
+			SIM_WIFI_SetLocalNetwork(strings, password, e.value, ip_address, NextString(ip_address));
+			break;
+		}
+	case SCENARIO_SERVER:
+		SIM_WIFI_SetServer(e.link_id, strings, NextString(strings));
+		break;
+	case SCENARIO_TRANSMIT:
+		SIM_WIFI_TransmitShared(e.link_id, data, e.size, g_scenario_data);
+		break;
+	case SCENARIO_RECEIVE:
+		SIM_WIFI_ReceiveShared(e.link_id, data, e.size, g_scenario_data);
+		break;
+	case SCENARIO_CONNECT:
+		SIM_WIFI_DeliverConnect(e.link_id);
+		break;
+	case SCENARIO_DISCONNECT:
+		SIM_WIFI_DeliverDisconnect(e.link_id);
+		break;
+	case SCENARIO_WAIT:
+		break;
+	}
+}
+
+static void RunScenarioEvent(uint32_t generation);
+
+static void AdvanceScenario()
+{
+	const auto& events = g_scenario_events;
+	while (g_scenario_cursor < events.size() && !IsInjectedEvent(events[g_scenario_cursor].op))
+		ApplyScenarioEvent(events[g_scenario_cursor++]);
+	if (g_scenario_cursor == events.size())
+	{
+		g_is_scenario_active = false;
+		return;
+	}
+	uint32_t generation = g_scenario_generation;
+	auto run = [generation]() { RunScenarioEvent(generation); };
+	if (events[g_scenario_cursor].op == SCENARIO_WAIT)
+		SIM_WIFI_AddTimer(RLM3_GetCurrentTime() + events[g_scenario_cursor].value, run);
+	else
+		SIM_WIFI_AddInterrupt(run);
+}
+
+static void RunScenarioEvent(uint32_t generation)
+{
+	if (generation != g_scenario_generation || !g_is_scenario_active)
+		return;
+	ApplyScenarioEvent(g_scenario_events[g_scenario_cursor++]);
+	AdvanceScenario();
+}
+
+extern bool SIM_WIFI_CompileScenario(const char* text_path, const char* binary_path)
+{
+	Scenario scenario;
+	if (!LoadScenario(text_path, scenario))
+		return false;
+	std::FILE* file = std::fopen(binary_path, "wb");
+	if (file == nullptr)
+	{
+		LOG_ERROR("WIFI scenario %s could not be created: %s", binary_path, std::strerror(errno));
+		return false;
+	}
+	std::vector<uint8_t> output(20 + scenario.events.size() * 16);
+	std::memcpy(output.data(), SIM_WIFI_SCENARIO_MAGIC, 8);
+	Put32(output.data() + 8, SIM_WIFI_SCENARIO_VERSION);
+	Put32(output.data() + 12, (uint32_t)scenario.events.size());
+	Put32(output.data() + 16, (uint32_t)scenario.data.size());
+	for (size_t i = 0; i < scenario.events.size(); i++)
+	{
+		const ScenarioEvent& e = scenario.events[i];
+		uint8_t* record = output.data() + 20 + i * 16;
+		record[0] = e.op;
+		record[1] = 0;
+		Put16(record + 2, e.link_id);
+		Put32(record + 4, e.value);
+		Put32(record + 8, e.offset);
+		Put32(record + 12, e.size);
+	}
+	output.insert(output.end(), scenario.data.begin(), scenario.data.end());
+	bool result = (std::fwrite(output.data(), output.size(), 1, file) == 1);
+	if (std::fclose(file) != 0)
+		result = false;
+	if (!result)
+		LOG_ERROR("WIFI scenario %s could not be written", binary_path);
+	return result;
+}
+
+extern bool SIM_WIFI_StartScenario(const char* path)
+{
+	SIM_WIFI_StopScenario();
+	Scenario scenario;
+	if (!LoadScenario(path, scenario))
+		return false;
+	g_scenario_events = std::move(scenario.events);
+	g_scenario_data = std::make_shared<const std::vector<uint8_t>>(std::move(scenario.data));
+	g_scenario_cursor = 0;
+	g_is_scenario_active = true;
+	AdvanceScenario();
+	return true;
+}
+
+extern void SIM_WIFI_StopScenario()
+{
+	g_is_scenario_active = false;
+	g_scenario_generation++;
+}
+
+extern bool SIM_WIFI_IsScenarioActive()
+{
+	return g_is_scenario_active;
+}
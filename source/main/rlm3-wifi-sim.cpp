@@ -1,334 +1,2298 @@
 #include "rlm3-wifi.h"
+#include "rlm3-wifi-sim.hpp"
+#include "rlm3-wifi-sim-capture.hpp"
 #include "rlm3-sim.hpp"
 #include "Test.hpp"
+#include "logger.h"
 #include <string>
-#include <queue>
-
-
-static bool g_fail_init;
-static bool g_is_active;
-static bool g_has_version;
-static uint32_t g_at_version;
-static uint32_t g_sdk_version;
-static bool g_has_network;
-static std::string g_ssid;
-static std::string g_password;
-static bool g_is_network_connected;
-
-static bool g_has_local_network;
-static std::string g_local_ssid;
-static std::string g_local_password;
-static size_t g_local_max_clients;
-static std::string g_local_ip_address;
-static std::string g_local_service;
-static bool g_is_local_network_enabled;
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+struct TransmitExpectation
+{
+	std::vector<uint8_t> buffer;
+	const uint8_t* external;
+	size_t size;
+	size_t offset;
+	// Checksum expectations keep only a running CRC so long streams are verified in constant memory.
+	bool is_checksum;
+	uint32_t crc;
+	uint32_t expected_crc;
+	// Keeps shared external data alive until it is verified.
+	std::shared_ptr<const void> owner;
+
+	const uint8_t* data() const { return (external != nullptr) ? external : buffer.data(); }
+};
+
+static_assert(RLM3_WIFI_LINK_COUNT > 0 && RLM3_WIFI_LINK_COUNT <= 0xFFFF, "link ids must fit the 16 bit capture format");
+
+// Snapshots copy whole links, so the link mutex copies as a fresh unlocked mutex.
+struct LinkMutex : std::mutex
+{
+	LinkMutex() = default;
+	LinkMutex(const LinkMutex&) {}
+	LinkMutex& operator=(const LinkMutex&) { return *this; }
+};
 
 struct ServerSettings
 {
+	// The expectation and in-flight queues are vectors with head indices and the strings stay empty until a
+	// server is configured, so an idle link costs only its fixed fields and large link counts stay cheap.  The mutex
+	// guards the per-link transmit and receive paths so links can be driven from separate host threads
+	// without contending.
+	LinkMutex mutex;
 	bool has_server;
-	std::string server;
-	std::string service;
 	bool is_connected;
 	bool is_local_connection;
-	std::queue<uint8_t> transmit_queue;
+	uint16_t bridge_port;
+	int bridge_socket = -1;
+	std::string server;
+	std::string service;
+	std::vector<TransmitExpectation> transmit_expected;
+	size_t transmit_head;
+	size_t transmit_pending;
+	size_t transmit_verified;
+
+	uint32_t bandwidth;
+	RLM3_Time latency;
+	RLM3_Time jitter;
+	RLM3_Time send_update_time;
+	size_t send_buffer_size;
+	uint64_t send_backlog;
+	uint64_t receive_remainder;
+	RLM3_Time receive_serial_time;
+	RLM3_Time receive_arrival_time;
+
+	// Non-blocking transmits stay in flight until their completion time.  The caller's buffer is read
+	// and verified at completion, so firmware that reuses a buffer too early fails the comparison.  A
+	// blocking transmit made while others are in flight is copied and queued behind them so the link
+	// stays in order.  Only non-blocking transmits count against the window.
+	struct InFlightTransmit
+	{
+		std::vector<uint8_t> buffer;
+		const uint8_t* external;
+		size_t size;
+		RLM3_Time complete_time;
+
+		const uint8_t* data() const { return (external != nullptr) ? external : buffer.data(); }
+	};
+	size_t transmit_window;
+	std::vector<InFlightTransmit> transmit_in_flight;
+	size_t transmit_in_flight_head;
+	size_t transmit_in_flight_count;
+	size_t transmit_in_flight_bytes;
+	RLM3_Time transmit_serial_time;
+
+	size_t pending_interrupts;
+	SIM_WIFI_Stats stats;
+
+	// The receive ring is firmware memory that arriving data is written into, like a UART DMA buffer.
+	uint8_t* ring;
+	size_t ring_size;
+	size_t ring_read;
+	size_t ring_count;
+
+	bool has_coalesce;
+	SIM_WIFI_Coalesce coalesce;
+	std::vector<uint8_t> coalesce_buffer;
+	RLM3_Time coalesce_first_time;
+	RLM3_Time coalesce_last_time;
+	bool is_coalesce_timer_pending;
+
+	bool has_faults;
+	SIM_WIFI_Faults faults;
+	uint32_t random_state;
+	uint32_t fault_random_state;
+
+	// Churn clients accept any transmit, and the first one answers the session.
+	struct ChurnClient
+	{
+		bool is_client;
+		bool is_answered;
+		RLM3_Time connect_time;
+		RLM3_Time end_time;
+		size_t sessions;
+		size_t responses;
+		RLM3_Time response_total;
+		RLM3_Time response_max;
+	};
+	ChurnClient churn;
 };
-static ServerSettings g_server_settings[RLM3_WIFI_LINK_COUNT];
 
-TEST_SETUP(SIM_WIFI_Init)
+enum TimedEventType : uint8_t
+{
+	TIMED_RECEIVE,
+	TIMED_ARRIVE,
+	TIMED_ARRIVE_STREAM,
+	TIMED_COALESCE,
+	TIMED_TRANSMIT,
+	TIMED_CONNECT,
+	TIMED_DISCONNECT,
+	TIMED_CHURN,
+	TIMED_CALLBACK,
+};
+
+struct ReceiveStream;
+
+struct TimedEvent
+{
+	// Receives enter the link model when they fire; arrivals are chunks that already crossed it.  The owner
+	// keeps copied data alive while the event is queued.  Callbacks are timers for other simulator parts.
+	RLM3_Time time;
+	uint64_t sequence;
+	TimedEventType type;
+	size_t link_id;
+	const uint8_t* data;
+	size_t size;
+	std::shared_ptr<const void> owner;
+	std::shared_ptr<ReceiveStream> stream;
+	std::function<void()> callback;
+
+	// Orders the heap earliest first; the sequence keeps events at the same time in scheduling order.
+	bool operator>(const TimedEvent& other) const { return (time != other.time) ? time > other.time : sequence > other.sequence; }
+};
+// All simulated device state lives in one instance so a process can simulate several devices.  The C API
+// acts on the instance selected by the calling thread, and interrupts run with the instance that queued them.
+struct WifiSim
+{
+	bool fail_init;
+	std::atomic<bool> is_active;
+	bool has_version;
+	uint32_t at_version;
+	uint32_t sdk_version;
+	bool has_network;
+	std::string ssid;
+	std::string password;
+	std::atomic<bool> is_network_connected;
+
+	bool has_local_network;
+	std::string local_ssid;
+	std::string local_password;
+	size_t local_max_clients;
+	std::string local_ip_address;
+	std::string local_service;
+	std::atomic<bool> is_local_network_enabled;
+
+	size_t receive_chunk_size;
+
+	SIM_WIFI_Faults faults;
+	bool is_fault_enabled;
+
+	// Transmit threads schedule completions and fault interrupts, so the timed heap, the pump flag and the
+	// base simulator queue are only touched under the schedule mutex.  Link mutexes are taken before it.
+	std::mutex schedule_mutex;
+	std::vector<TimedEvent> timed_events;
+	uint64_t timed_sequence;
+	bool is_timed_pump_scheduled;
+	// The pump waits for the earliest event.  Only the pump of the current generation runs events; the ones it
+	// replaced return when they come up.  Queued pumps, stale ones included, count as pending interrupts.
+	uint32_t timed_pump_generation;
+	RLM3_Time timed_pump_time;
+	size_t timed_pumps_queued;
+
+	uint16_t local_bridge_port;
+	int local_bridge_socket = -1;
+	bool is_bridge_poll_scheduled;
+
+	ServerSettings server_settings[RLM3_WIFI_LINK_COUNT];
+
+	struct ChurnState
+	{
+		bool is_active;
+		bool is_pump_scheduled;
+		SIM_WIFI_Churn config;
+		size_t sessions_started;
+		RLM3_Time next_connect_time;
+		uint32_t random_state;
+		size_t deferred_connects;
+		size_t peak_clients;
+		uint64_t callback_ns;
+		uint64_t callback_max_ns;
+		std::shared_ptr<const std::vector<uint8_t>> data;
+	};
+	ChurnState churn;
+
+	std::atomic<size_t> pending_interrupts;
+	RLM3_Time snapshot_time;
+};
+static WifiSim g_default_sim;
+static thread_local WifiSim* g_sim = &g_default_sim;
+
+template <typename F>
+static void AddSimInterruptLocked(F interrupt)
+{
+	// Callers hold the schedule mutex.
+	WifiSim* sim = g_sim;
+	sim->pending_interrupts++;
+	SIM_AddInterrupt([sim, interrupt]() {
+		sim->pending_interrupts--;
+		WifiSim* previous = g_sim;
+		g_sim = sim;
+		interrupt();
+		g_sim = previous;
+	});
+}
+
+template <typename F>
+static void AddSimInterrupt(F interrupt)
+{
+	std::lock_guard<std::mutex> lock(g_sim->schedule_mutex);
+	AddSimInterruptLocked(interrupt);
+}
+
+static uint32_t GetLinkSeed(uint32_t seed, size_t link_id)
+{
+	// Each link has its own random stream so links do not share state, and xorshift needs a non-zero seed.
+	uint32_t link_seed = seed ^ (uint32_t)((link_id + 1) * 0x9E3779B9);
+	return (link_seed != 0) ? link_seed : 0x9E3779B9;
+}
+
+static void CloseLink(ServerSettings& s)
+{
+	if (s.bridge_socket >= 0)
+		::close(s.bridge_socket);
+	s.bridge_socket = -1;
+	s.coalesce_buffer.clear();
+	s.coalesce_first_time = 0;
+	s.coalesce_last_time = 0;
+	s.transmit_in_flight.clear();
+	s.transmit_in_flight_head = 0;
+	s.transmit_in_flight_count = 0;
+	s.transmit_in_flight_bytes = 0;
+}
+
+static void CloseLocalBridge()
+{
+	if (g_sim->local_bridge_socket >= 0)
+		::close(g_sim->local_bridge_socket);
+	g_sim->local_bridge_socket = -1;
+}
+
+#ifndef RLM3_WIFI_SIM_AT
+static bool WriteReceiveRing(size_t link_id, const uint8_t* data, size_t size)
+{
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (s.ring == nullptr)
+		return false;
+	size_t count = std::min(size, s.ring_size - s.ring_count);
+	size_t write = (s.ring_read + s.ring_count) % s.ring_size;
+	size_t first = std::min(count, s.ring_size - write);
+	std::memcpy(s.ring + write, data, first);
+	std::memcpy(s.ring, data + first, count - first);
+	s.ring_count += count;
+	s.stats.receive_ring_high_water = std::max(s.stats.receive_ring_high_water, s.ring_count);
+	if (count < size)
+	{
+		// Like a DMA overrun, data that does not fit is lost.
+		LOG_ERROR("WIFI link %zu receive ring overrun: %zu bytes lost", link_id, size - count);
+		s.stats.receive_overrun_bytes += size - count;
+	}
+	return true;
+}
+#endif
+
+static void NotifyReceive(size_t link_id, const uint8_t* data, size_t size)
+{
+#ifdef RLM3_WIFI_SIM_AT
+	SIM_WIFI_AT_NotifyReceive(link_id, data, size);
+#else
+	if (SIM_WIFI_AT_IsActive())
+		SIM_WIFI_AT_NotifyReceive(link_id, data, size);
+	else if (WriteReceiveRing(link_id, data, size))
+		RLM3_WIFI_ReceiveReady_Callback(link_id);
+	else
+		RLM3_WIFI_ReceiveBlock_Callback(link_id, data, size);
+#endif
+}
+
+static void NotifyConnect(size_t link_id, bool local_connection)
+{
+#ifdef RLM3_WIFI_SIM_AT
+	SIM_WIFI_AT_NotifyConnect(link_id);
+#else
+	if (SIM_WIFI_AT_IsActive())
+		SIM_WIFI_AT_NotifyConnect(link_id);
+	else
+		RLM3_WIFI_NetworkConnect_Callback(link_id, local_connection);
+#endif
+}
+
+static void NotifyDisconnect(size_t link_id, bool local_connection)
 {
-	g_is_active = false;
-	g_fail_init = false;
-	g_has_version = false;
-	g_has_network = false;
-	g_is_network_connected = false;
-	g_has_local_network = false;
-	g_is_local_network_enabled = false;
-	for (auto& s : g_server_settings)
+#ifdef RLM3_WIFI_SIM_AT
+	SIM_WIFI_AT_NotifyDisconnect(link_id);
+#else
+	if (SIM_WIFI_AT_IsActive())
+		SIM_WIFI_AT_NotifyDisconnect(link_id);
+	else
+		RLM3_WIFI_NetworkDisconnect_Callback(link_id, local_connection);
+#endif
+}
+
+static void NotifyTransmitComplete(size_t link_id)
+{
+	// The emulated AT module reports SEND OK synchronously, so there is nothing to forward to it.
+#ifndef RLM3_WIFI_SIM_AT
+	if (!SIM_WIFI_AT_IsActive())
+		RLM3_WIFI_TransmitComplete_Callback(link_id);
+#endif
+}
+
+static void ResetSim()
+{
+	g_sim->pending_interrupts = 0;
+	g_sim->is_active = false;
+	g_sim->fail_init = false;
+	g_sim->has_version = false;
+	g_sim->has_network = false;
+	g_sim->is_network_connected = false;
+	g_sim->has_local_network = false;
+	g_sim->is_local_network_enabled = false;
+	g_sim->receive_chunk_size = 0;
+	g_sim->faults = {};
+	g_sim->is_fault_enabled = false;
+	g_sim->local_bridge_port = 0;
+	CloseLocalBridge();
+	g_sim->is_bridge_poll_scheduled = false;
+	g_sim->timed_events.clear();
+	g_sim->timed_events.shrink_to_fit();
+	g_sim->timed_sequence = 0;
+	g_sim->is_timed_pump_scheduled = false;
+	g_sim->timed_pump_generation++;
+	g_sim->timed_pumps_queued = 0;
+	g_sim->churn = {};
+	for (auto& s : g_sim->server_settings)
 	{
 		s.has_server = false;
 		s.is_connected = false;
-		while (!s.transmit_queue.empty())
-			s.transmit_queue.pop();
+		s.transmit_expected.clear();
+		s.transmit_expected.shrink_to_fit();
+		s.transmit_head = 0;
+		s.transmit_pending = 0;
+		s.transmit_verified = 0;
+		s.bandwidth = 0;
+		s.latency = 0;
+		s.jitter = 0;
+		s.send_buffer_size = 0;
+		s.send_backlog = 0;
+		s.send_update_time = 0;
+		s.receive_remainder = 0;
+		s.receive_serial_time = 0;
+		s.receive_arrival_time = 0;
+		s.transmit_window = 1;
+		s.transmit_serial_time = 0;
+		s.bridge_port = 0;
+		CloseLink(s);
+		s.pending_interrupts = 0;
+		s.stats = {};
+		s.has_faults = false;
+		s.faults = {};
+		s.has_coalesce = false;
+		s.coalesce = {};
+		s.coalesce_buffer.clear();
+		s.coalesce_buffer.shrink_to_fit();
+		s.transmit_in_flight.shrink_to_fit();
+		s.is_coalesce_timer_pending = false;
+		s.churn = {};
+		s.ring = nullptr;
+		s.ring_size = 0;
+		s.ring_read = 0;
+		s.ring_count = 0;
+	}
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		s.random_state = GetLinkSeed(0x12345678, link_id);
+		s.fault_random_state = GetLinkSeed(0x87654321, link_id);
 	}
 }
 
-extern bool RLM3_WIFI_Init()
+TEST_SETUP(SIM_WIFI_Init)
 {
-	ASSERT(!g_is_active);
-	if (g_fail_init)
-		return false;
-	g_is_active = true;
-	return true;
+	g_sim = &g_default_sim;
+	ResetSim();
 }
 
-extern void RLM3_WIFI_Deinit()
+static void CloseSim()
+{
+	CloseLocalBridge();
+	for (auto& s : g_sim->server_settings)
+		CloseLink(s);
+}
+
+template <typename F>
+static void AddLinkInterrupt(size_t link_id, F interrupt)
 {
-	ASSERT(g_is_active);
-	g_is_active = false;
-	g_is_network_connected = false;
-	for (auto& s : g_server_settings)
+	// Callers hold the link mutex.
+	auto& s = g_sim->server_settings[link_id];
+	s.pending_interrupts++;
+	s.stats.pending_interrupt_high_water = std::max(s.stats.pending_interrupt_high_water, s.pending_interrupts);
+	AddSimInterrupt([link_id, interrupt]() {
+		{
+			auto& s = g_sim->server_settings[link_id];
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.pending_interrupts--;
+		}
+		interrupt();
+	});
+}
+
+static void DropLinks()
+{
+	for (auto& s : g_sim->server_settings)
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.is_connected)
+		{
+			s.stats.disconnect_count++;
+			s.stats.last_disconnect_time = RLM3_GetCurrentTime();
+		}
 		s.is_connected = false;
+		CloseLink(s);
+	}
 }
 
-extern bool RLM3_WIFI_IsInit()
+static uint32_t NextRandom(uint32_t& state)
 {
-	return g_is_active;
+	// xorshift32 keeps simulated jitter and faults deterministic from run to run.
+	uint32_t x = state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	state = x;
+	return x;
 }
 
-extern bool RLM3_WIFI_GetVersion(uint32_t* at_version, uint32_t* sdk_version)
+static const SIM_WIFI_Faults& GetFaults(const ServerSettings& s)
 {
-	ASSERT(g_is_active);
-	if (!g_has_version)
+	return s.has_faults ? s.faults : g_sim->faults;
+}
+
+static bool RollFault(ServerSettings& s, double probability)
+{
+	if (probability <= 0.0)
+		return false;
+	if (NextRandom(s.fault_random_state) >= probability * 4294967296.0)
 		return false;
-	*at_version = g_at_version;
-	*sdk_version = g_sdk_version;
+	s.stats.fault_count++;
 	return true;
 }
 
-extern bool RLM3_WIFI_NetworkConnect(const char* ssid, const char* password)
+static bool IsSendBufferFull(ServerSettings& s, size_t size)
 {
-	ASSERT(g_is_active);
-	ASSERT(!g_is_network_connected);
-	if (!g_has_network)
+	if (s.bandwidth == 0 || s.send_buffer_size == 0)
 		return false;
-	ASSERT(ssid == g_ssid);
-	ASSERT(password == g_password);
-	g_is_network_connected = true;
-	return true;
+	ASSERT(size <= s.send_buffer_size);
+	// Backlog is kept in byte-milliseconds so slow links drain without rounding loss.
+	RLM3_Time now = RLM3_GetCurrentTime();
+	uint64_t drained = (uint64_t)(now - s.send_update_time) * s.bandwidth;
+	s.send_backlog -= std::min(drained, s.send_backlog);
+	s.send_update_time = now;
+	return s.send_backlog + size * 1000 > s.send_buffer_size * 1000;
 }
 
-extern void RLM3_WIFI_NetworkDisconnect()
+static void AddSendBacklog(ServerSettings& s, size_t size)
 {
-	ASSERT(g_is_network_connected);
-	g_is_network_connected = false;
-	for (auto& s : g_server_settings)
-		s.is_connected = false;
+	if (s.bandwidth != 0 && s.send_buffer_size != 0)
+		s.send_backlog += size * 1000;
 }
 
-extern bool RLM3_WIFI_IsNetworkConnected()
+static bool HasLinkModel(const ServerSettings& s)
 {
-	return g_is_network_connected;
+	return s.bandwidth > 0 || s.latency > 0 || s.jitter > 0;
 }
 
-extern bool RLM3_WIFI_ServerConnect(size_t link_id, const char* server, const char* service)
+static RLM3_Time GetReceiveLatency(ServerSettings& s)
 {
-	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	ASSERT(g_is_active);
-	ASSERT(g_is_network_connected);
-	auto& s = g_server_settings[link_id];
-	ASSERT(!s.is_connected);
-	if (!s.has_server)
-		return false;
-	ASSERT(server == s.server);
-	ASSERT(service == s.service);
-	s.is_connected = true;
-	s.is_local_connection = false;
-	bool is_local_connection = s.is_local_connection;
-	SIM_DoInterrupt([=] {
-		RLM3_WIFI_NetworkConnect_Callback(link_id, is_local_connection);
-	});
-	return true;
+	// Jitter is drawn once per payload so its chunks stay together.
+	RLM3_Time latency = s.latency;
+	if (s.jitter > 0)
+		latency += NextRandom(s.random_state) % (s.jitter + 1);
+	return latency;
 }
 
-extern void RLM3_WIFI_ServerDisconnect(size_t link_id)
+static RLM3_Time GetReceiveArrival(ServerSettings& s, size_t size, RLM3_Time latency, bool is_continued)
 {
-	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	ASSERT(g_is_active);
-	ASSERT(g_is_network_connected);
-	auto& s = g_server_settings[link_id];
-	ASSERT(s.is_connected);
-	s.is_connected = false;
-	bool is_local_connection = s.is_local_connection;
-	SIM_DoInterrupt([=] {
-		RLM3_WIFI_NetworkDisconnect_Callback(link_id, is_local_connection);
-	});
+	// Only bandwidth is shared: a chunk starts on the wire once the link is free, and latency overlaps with
+	// whatever is queued behind it.  A continued chunk follows the previous one back to back even if it is
+	// scheduled later.  TCP delivers in order, so jitter never lets a chunk overtake the one before it.
+	RLM3_Time start = is_continued ? s.receive_serial_time : std::max(RLM3_GetCurrentTime(), s.receive_serial_time);
+	RLM3_Time serial = 0;
+	if (s.bandwidth > 0)
+	{
+		uint64_t total = (uint64_t)size * 1000 + s.receive_remainder;
+		serial = (RLM3_Time)(total / s.bandwidth);
+		s.receive_remainder = total % s.bandwidth;
+	}
+	s.receive_serial_time = start + serial;
+	s.receive_arrival_time = std::max(s.receive_arrival_time, s.receive_serial_time + latency);
+	return s.receive_arrival_time;
 }
 
-extern bool RLM3_WIFI_IsServerConnected(size_t link_id)
+static bool HasTransmitExpected(const ServerSettings& s)
+{
+	return s.transmit_pending > 0;
+}
+
+static const uint32_t* GetCrc32Table()
+{
+	static const auto table = [] {
+		std::array<uint32_t, 256> table;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (size_t bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+			table[i] = crc;
+		}
+		return table;
+	}();
+	return table.data();
+}
+
+#if RLM3_WIFI_SIM_VERIFY >= 1
+static void VerifyTransmitChecksum(size_t link_id, ServerSettings& s, TransmitExpectation& e, const uint8_t* data, size_t count)
+{
+	e.crc = SIM_WIFI_Crc32(e.crc, data, count);
+	if (e.offset + count == e.size && e.crc != e.expected_crc)
+	{
+		LOG_ERROR("WIFI link %zu transmit checksum mismatch for bytes %zu-%zu: expected 0x%08x actual 0x%08x", link_id, s.transmit_verified + count - e.size, s.transmit_verified + count, e.expected_crc, e.crc);
+		ASSERT(e.crc == e.expected_crc);
+	}
+}
+
+static void VerifyTransmitBytes(size_t link_id, ServerSettings& s, const uint8_t* expected, const uint8_t* data, size_t count)
+{
+	if (std::memcmp(expected, data, count) == 0)
+		return;
+	size_t offset = 0;
+	while (expected[offset] == data[offset])
+		offset++;
+	LOG_ERROR("WIFI link %zu transmit mismatch at byte %zu: expected 0x%02x actual 0x%02x", link_id, s.transmit_verified + offset, expected[offset], data[offset]);
+	ASSERT(data[offset] == expected[offset]);
+}
+#endif
+
+static void VerifyTransmit(size_t link_id, ServerSettings& s, const uint8_t* data, size_t size)
+{
+	ASSERT(size <= s.transmit_pending);
+	while (size > 0)
+	{
+		auto& e = s.transmit_expected[s.transmit_head];
+		size_t count = std::min(size, e.size - e.offset);
+#if RLM3_WIFI_SIM_VERIFY >= 1
+		if (e.is_checksum)
+			VerifyTransmitChecksum(link_id, s, e, data, count);
+		else
+			VerifyTransmitBytes(link_id, s, e.data() + e.offset, data, count);
+#endif
+		e.offset += count;
+		if (e.offset == e.size && ++s.transmit_head == s.transmit_expected.size())
+		{
+			s.transmit_expected.clear();
+			s.transmit_head = 0;
+		}
+		s.transmit_pending -= count;
+		s.transmit_verified += count;
+		data += count;
+		size -= count;
+	}
+}
+
+static void ReserveTransmitExpected(ServerSettings& s, size_t size)
+{
+	s.transmit_pending += size;
+	s.stats.transmit_pending_high_water = std::max(s.stats.transmit_pending_high_water, s.transmit_pending);
+	if (s.transmit_head > 0 && s.transmit_head >= s.transmit_expected.size() / 2)
+	{
+		s.transmit_expected.erase(s.transmit_expected.begin(), s.transmit_expected.begin() + s.transmit_head);
+		s.transmit_head = 0;
+	}
+}
+
+static void AddTransmitExpected(size_t link_id, const uint8_t* data, size_t size, bool copy, std::shared_ptr<const void> owner)
 {
 	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	auto& s = g_server_settings[link_id];
-	return s.is_connected;
+	if (size == 0)
+		return;
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	ReserveTransmitExpected(s, size);
+	if (!copy)
+	{
+		s.transmit_expected.push_back({ {}, data, size, 0, false, 0, 0, std::move(owner) });
+		return;
+	}
+	if (s.transmit_head == s.transmit_expected.size() || s.transmit_expected.back().external != nullptr || s.transmit_expected.back().is_checksum)
+		s.transmit_expected.push_back({ {}, nullptr, 0, 0 });
+	auto& e = s.transmit_expected.back();
+	if (e.offset > 0 && e.offset >= e.size / 2)
+	{
+		e.buffer.erase(e.buffer.begin(), e.buffer.begin() + e.offset);
+		e.size -= e.offset;
+		e.offset = 0;
+	}
+	e.buffer.insert(e.buffer.end(), data, data + size);
+	e.size += size;
 }
 
-extern bool RLM3_WIFI_LocalNetworkEnable(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service)
+static void AddTimedEvent(size_t link_id, RLM3_Time time, TimedEventType type, const uint8_t* data, size_t size, std::shared_ptr<const void> owner, std::shared_ptr<ReceiveStream> stream);
+
+static void AddLinkTimedEvent(size_t link_id, RLM3_Time time, TimedEventType type, const uint8_t* data, size_t size, std::shared_ptr<const void> owner, std::shared_ptr<ReceiveStream> stream)
+{
+	// Callers hold the link mutex.  Link timers wait in the timed heap so one link's latency never holds
+	// back another link; they count as pending interrupts for the link statistics.
+	auto& s = g_sim->server_settings[link_id];
+	s.pending_interrupts++;
+	s.stats.pending_interrupt_high_water = std::max(s.stats.pending_interrupt_high_water, s.pending_interrupts);
+	AddTimedEvent(link_id, time, type, data, size, std::move(owner), std::move(stream));
+}
+
+static bool IsCoalesceDue(const ServerSettings& s, RLM3_Time now)
 {
-	ASSERT(!g_is_local_network_enabled);
-	if (!g_has_local_network)
+	if (s.coalesce_buffer.empty())
 		return false;
-	ASSERT(ssid == g_local_ssid);
-	ASSERT(password == g_local_password);
-	ASSERT(max_clients == g_local_max_clients);
-	ASSERT(ip_address == g_local_ip_address);
-	ASSERT(service == g_local_service);
-	g_is_local_network_enabled = true;
-	return true;
+	if (s.coalesce.idle_timeout > 0 && now - s.coalesce_last_time >= s.coalesce.idle_timeout)
+		return true;
+	if (s.coalesce.max_latency > 0 && now - s.coalesce_first_time >= s.coalesce.max_latency)
+		return true;
+	return false;
 }
 
-extern void RLM3_WIFI_LocalNetworkDisable()
+static void DeliverCoalesced(size_t link_id, std::unique_lock<std::mutex>& lock, bool flush)
 {
-	ASSERT(g_is_local_network_enabled);
-	g_is_local_network_enabled = false;
+	// Whole bursts are delivered; a flush also delivers the partial burst left over.
+	auto& s = g_sim->server_settings[link_id];
+	size_t size = s.coalesce_buffer.size();
+	size_t burst = (s.coalesce.burst_size == 0) ? size : s.coalesce.burst_size;
+	size_t total = flush ? size : size - size % burst;
+	if (total == 0)
+		return;
+	std::vector<uint8_t> ready(s.coalesce_buffer.begin(), s.coalesce_buffer.begin() + total);
+	s.coalesce_buffer.erase(s.coalesce_buffer.begin(), s.coalesce_buffer.begin() + total);
+	s.coalesce_first_time = RLM3_GetCurrentTime();
+	lock.unlock();
+	for (size_t offset = 0; offset < total; offset += burst)
+		SIM_WIFI_DeliverReceive(link_id, ready.data() + offset, std::min(burst, total - offset));
+	lock.lock();
 }
 
-extern bool RLM3_WIFI_IsLocalNetworkEnabled()
+static void ScheduleCoalesceTimer(size_t link_id)
 {
-	return g_is_local_network_enabled;
+	// Callers hold the link mutex.  Only one timer is outstanding per link; it re-arms itself while data
+	// keeps arriving.
+	auto& s = g_sim->server_settings[link_id];
+	if (s.is_coalesce_timer_pending || s.coalesce_buffer.empty())
+		return;
+	if (s.coalesce.idle_timeout == 0 && s.coalesce.max_latency == 0)
+		return;
+	RLM3_Time now = RLM3_GetCurrentTime();
+	RLM3_Time wait = (RLM3_Time)-1;
+	if (s.coalesce.idle_timeout > 0)
+		wait = std::min(wait, s.coalesce_last_time + s.coalesce.idle_timeout - now);
+	if (s.coalesce.max_latency > 0)
+		wait = std::min(wait, s.coalesce_first_time + s.coalesce.max_latency - now);
+	s.is_coalesce_timer_pending = true;
+	AddLinkTimedEvent(link_id, now + wait, TIMED_COALESCE, nullptr, 0, nullptr, nullptr);
 }
 
-extern bool RLM3_WIFI_Transmit(size_t link_id, const uint8_t* data, size_t size)
+static void RunCoalesceTimer(size_t link_id)
+{
+	auto& s = g_sim->server_settings[link_id];
+	std::unique_lock<std::mutex> lock(s.mutex);
+	s.pending_interrupts--;
+	s.is_coalesce_timer_pending = false;
+	if (IsCoalesceDue(s, RLM3_GetCurrentTime()))
+		DeliverCoalesced(link_id, lock, true);
+	ScheduleCoalesceTimer(link_id);
+}
+
+static void ArriveReceive(size_t link_id, const uint8_t* data, size_t size)
+{
+	auto& s = g_sim->server_settings[link_id];
+	std::unique_lock<std::mutex> lock(s.mutex);
+	if (!s.has_coalesce || (g_sim->is_fault_enabled && !s.is_connected))
+	{
+		lock.unlock();
+		SIM_WIFI_DeliverReceive(link_id, data, size);
+		return;
+	}
+	RLM3_Time now = RLM3_GetCurrentTime();
+	if (IsCoalesceDue(s, now))
+		DeliverCoalesced(link_id, lock, true);
+	if (s.coalesce_buffer.empty())
+		s.coalesce_first_time = now;
+	s.coalesce_last_time = now;
+	s.coalesce_buffer.insert(s.coalesce_buffer.end(), data, data + size);
+	if (s.coalesce.burst_size > 0)
+		DeliverCoalesced(link_id, lock, false);
+	ScheduleCoalesceTimer(link_id);
+}
+
+static void AddReceive(size_t link_id, const uint8_t* data, size_t size, std::shared_ptr<const void> owner)
 {
 	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	ASSERT(g_is_active);
-	ASSERT(g_is_network_connected || g_is_local_network_enabled);
-	auto& s = g_server_settings[link_id];
-	ASSERT(s.is_connected);
-	ASSERT(size > 0 && size <= 1024);
-	if (s.transmit_queue.empty())
-		return false;
-	for (size_t i = 0; i < size; i++)
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	size_t chunk_size = (g_sim->receive_chunk_size == 0) ? size : g_sim->receive_chunk_size;
+	bool is_fragmented = g_sim->is_fault_enabled && RollFault(s, GetFaults(s).receive_fragment);
+	bool has_link_model = HasLinkModel(s);
+	RLM3_Time latency = has_link_model ? GetReceiveLatency(s) : 0;
+	size_t count = 0;
+	for (size_t offset = 0; offset < size; offset += count)
 	{
-		ASSERT(!s.transmit_queue.empty());
-		uint8_t expected_transmit_byte = s.transmit_queue.front();
-		s.transmit_queue.pop();
-		uint8_t actual_transmit_byte = data[i];
-		ASSERT(actual_transmit_byte == expected_transmit_byte);
+		const uint8_t* chunk = data + offset;
+		count = std::min(chunk_size, size - offset);
+		if (is_fragmented)
+			count = 1 + NextRandom(s.fault_random_state) % count;
+		if (has_link_model)
+		{
+			AddLinkTimedEvent(link_id, GetReceiveArrival(s, count, latency, false), TIMED_ARRIVE, chunk, count, owner, nullptr);
+			continue;
+		}
+		AddLinkInterrupt(link_id, [link_id, chunk, count, owner]() {
+			ArriveReceive(link_id, chunk, count);
+		});
 	}
-	return true;
 }
 
-extern bool RLM3_WIFI_Transmit2(size_t link_id, const uint8_t* data_a, size_t size_a, const uint8_t* data_b, size_t size_b)
+struct ReceiveStream
+{
+	// Only one chunk is held at a time; the next one is pulled after the previous one is delivered.
+	SIM_WIFI_ReceiveSource source;
+	void* context;
+	std::FILE* file;
+	std::vector<uint8_t> buffer;
+	bool is_first;
+	RLM3_Time latency;
+
+	~ReceiveStream() { if (file != nullptr) std::fclose(file); }
+};
+
+static size_t ReadReceiveFile(void* context, uint8_t* buffer, size_t size)
+{
+	return std::fread(buffer, 1, size, (std::FILE*)context);
+}
+
+static void ScheduleReceiveStream(size_t link_id, std::shared_ptr<ReceiveStream> stream);
+
+static void ArriveReceiveStream(size_t link_id, const std::shared_ptr<ReceiveStream>& stream, size_t count)
+{
+	ArriveReceive(link_id, stream->buffer.data(), count);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	// A link closed by an injected fault ends the stream.
+	if (s.is_connected)
+		ScheduleReceiveStream(link_id, stream);
+}
+
+static void ScheduleReceiveStream(size_t link_id, std::shared_ptr<ReceiveStream> stream)
+{
+	// Callers hold the link mutex.
+	auto& s = g_sim->server_settings[link_id];
+	size_t count = stream->source(stream->context, stream->buffer.data(), stream->buffer.size());
+	ASSERT(count <= stream->buffer.size());
+	if (count == 0)
+		return;
+	bool is_continued = !stream->is_first;
+	stream->is_first = false;
+	if (HasLinkModel(s))
+	{
+		if (!is_continued)
+			stream->latency = GetReceiveLatency(s);
+		RLM3_Time arrival = GetReceiveArrival(s, count, stream->latency, is_continued);
+		AddLinkTimedEvent(link_id, arrival, TIMED_ARRIVE_STREAM, nullptr, count, nullptr, std::move(stream));
+		return;
+	}
+	AddLinkInterrupt(link_id, [link_id, stream, count]() {
+		ArriveReceiveStream(link_id, stream, count);
+	});
+}
+
+static void AddReceiveStream(size_t link_id, std::shared_ptr<ReceiveStream> stream)
 {
 	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	ASSERT(g_is_active);
-	ASSERT(g_is_network_connected || g_is_local_network_enabled);
-	auto& s = g_server_settings[link_id];
-	ASSERT(s.is_connected);
-	ASSERT(size_a > 0 && size_a <= 1024);
-	ASSERT(size_b > 0 && size_b <= 1024);
-	ASSERT(size_a + size_b <= 1024);
-	if (s.transmit_queue.empty())
-		return false;
-	for (size_t i = 0; i < size_a; i++)
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	stream->buffer.resize((g_sim->receive_chunk_size == 0) ? 1024 : g_sim->receive_chunk_size);
+	stream->is_first = true;
+	ScheduleReceiveStream(link_id, stream);
+}
+
+static sockaddr_in GetBridgeAddress(uint16_t port)
+{
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return address;
+}
+
+static int OpenBridgeConnection(uint16_t port)
+{
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	sockaddr_in address = GetBridgeAddress(port);
+	if (::connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		LOG_ERROR("WIFI bridge connect to port %u failed: %s", port, std::strerror(errno));
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int OpenBridgeListener(uint16_t port)
+{
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	int reuse = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	sockaddr_in address = GetBridgeAddress(port);
+	if (::bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, 16) != 0)
 	{
-		ASSERT(!s.transmit_queue.empty());
-		uint8_t expected_transmit_byte = s.transmit_queue.front();
-		s.transmit_queue.pop();
-		uint8_t actual_transmit_byte = data_a[i];
-		ASSERT(actual_transmit_byte == expected_transmit_byte);
+		LOG_ERROR("WIFI bridge listen on port %u failed: %s", port, std::strerror(errno));
+		::close(fd);
+		return -1;
 	}
-	for (size_t i = 0; i < size_b; i++)
+	return fd;
+}
+
+static bool BridgeSend(ServerSettings& s, const uint8_t* data, size_t size)
+{
+	while (size > 0)
 	{
-		ASSERT(!s.transmit_queue.empty());
-		uint8_t expected_transmit_byte = s.transmit_queue.front();
-		s.transmit_queue.pop();
-		uint8_t actual_transmit_byte = data_b[i];
-		ASSERT(actual_transmit_byte == expected_transmit_byte);
+		ssize_t sent = ::send(s.bridge_socket, data, size, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		size -= sent;
 	}
 	return true;
 }
 
-extern __attribute__((weak)) void RLM3_WIFI_Receive_Callback(uint8_t data)
+static size_t CountLocalClients()
 {
-	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+	size_t client_count = 0;
+	for (auto& s : g_sim->server_settings)
+		if (s.is_connected && s.is_local_connection)
+			client_count++;
+	return client_count;
 }
 
-extern __attribute__((weak)) void RLM3_WIFI_NetworkConnect_Callback(size_t link_id, bool local_connection)
+static void BridgeAccept()
 {
-	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+	int fd = ::accept(g_sim->local_bridge_socket, nullptr, nullptr);
+	if (fd < 0)
+		return;
+	size_t client_count = CountLocalClients();
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT && client_count < g_sim->local_max_clients; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		if (s.is_connected)
+			continue;
+		CloseLink(s);
+		s.bridge_socket = fd;
+		s.is_connected = true;
+		s.is_local_connection = true;
+		s.stats.connect_count++;
+		s.stats.last_connect_time = RLM3_GetCurrentTime();
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_CONNECT, link_id, SIM_WIFI_CaptureFlags(true, true));
+		NotifyConnect(link_id, true);
+		return;
+	}
+	::close(fd);
 }
 
-extern __attribute__((weak)) void RLM3_WIFI_NetworkDisconnect_Callback(size_t link_id, bool local_connection)
+static void BridgeReceive(size_t link_id)
 {
-	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+	auto& s = g_sim->server_settings[link_id];
+	uint8_t buffer[1024];
+	size_t limit = (g_sim->receive_chunk_size == 0) ? sizeof(buffer) : std::min(g_sim->receive_chunk_size, sizeof(buffer));
+	ssize_t count = ::recv(s.bridge_socket, buffer, limit, 0);
+	if (count > 0)
+	{
+		s.stats.receive_bytes += count;
+		s.stats.last_receive_time = RLM3_GetCurrentTime();
+		s.stats.receive_callbacks++;
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_RECEIVE, link_id, SIM_WIFI_CaptureFlags(s.is_local_connection, true), buffer, count);
+		NotifyReceive(link_id, buffer, count);
+		return;
+	}
+	CloseLink(s);
+	s.is_connected = false;
+	s.stats.disconnect_count++;
+	s.stats.last_disconnect_time = RLM3_GetCurrentTime();
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_DISCONNECT, link_id, SIM_WIFI_CaptureFlags(s.is_local_connection, true));
+	NotifyDisconnect(link_id, s.is_local_connection);
 }
 
+static void ScheduleBridgePoll();
 
-extern void SIM_WIFI_InitFailure()
+static void PollBridge()
 {
-	g_fail_init = true;
+	// Wait briefly for socket activity so a task blocked on the simulator does not spin.
+	g_sim->is_bridge_poll_scheduled = false;
+	std::vector<pollfd> fds;
+	std::vector<size_t> links;
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		if (s.is_connected && s.bridge_socket >= 0)
+		{
+			fds.push_back({ s.bridge_socket, POLLIN, 0 });
+			links.push_back(link_id);
+		}
+	}
+	if (g_sim->local_bridge_socket >= 0)
+		fds.push_back({ g_sim->local_bridge_socket, POLLIN, 0 });
+	if (fds.empty())
+		return;
+	if (::poll(fds.data(), fds.size(), 10) > 0)
+	{
+		for (size_t i = 0; i < links.size(); i++)
+			if (fds[i].revents != 0)
+				BridgeReceive(links[i]);
+		if (g_sim->local_bridge_socket >= 0 && fds.back().revents != 0)
+			BridgeAccept();
+	}
+	ScheduleBridgePoll();
 }
 
-extern void SIM_WIFI_SetVersion(uint32_t at_version, uint32_t sdk_version)
+static void ScheduleBridgePoll()
 {
-	g_has_version = true;
-	g_at_version = at_version;
-	g_sdk_version = sdk_version;
+	if (g_sim->is_bridge_poll_scheduled)
+		return;
+	bool is_bridge_active = (g_sim->local_bridge_socket >= 0);
+	for (auto& s : g_sim->server_settings)
+		if (s.is_connected && s.bridge_socket >= 0)
+			is_bridge_active = true;
+	if (!is_bridge_active)
+		return;
+	g_sim->is_bridge_poll_scheduled = true;
+	AddSimInterrupt(PollBridge);
 }
 
-extern void SIM_WIFI_SetNetwork(const char* ssid, const char* password)
+extern bool SIM_WIFI_ModuleInit()
 {
-	g_has_network = true;
-	g_ssid = ssid;
-	g_password = password;
+	SIM_WIFI_VERIFY(!g_sim->is_active);
+	if (g_sim->fail_init)
+		return false;
+	g_sim->is_active = true;
+	return true;
 }
 
-extern void SIM_WIFI_SetLocalNetwork(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service)
+extern void SIM_WIFI_ModuleDeinit()
 {
-	g_has_local_network = true;
-	g_local_ssid = ssid;
-	g_local_password = password;
-	g_local_max_clients = max_clients;
-	g_local_ip_address = ip_address;
-	g_local_service = service;
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	if (g_sim->is_network_connected)
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_DOWN, 0, SIM_WIFI_CaptureFlags(false));
+	if (g_sim->is_local_network_enabled)
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_DOWN, 0, SIM_WIFI_CaptureFlags(true));
+	g_sim->is_active = false;
+	g_sim->is_network_connected = false;
+	CloseLocalBridge();
+	DropLinks();
 }
 
-extern void SIM_WIFI_SetServer(size_t link_id, const char* server, const char* service)
+extern bool SIM_WIFI_ModuleIsInit()
 {
-	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	auto& s = g_server_settings[link_id];
-	s.has_server = true;
-	s.server = server;
-	s.service = service;
+	return g_sim->is_active;
 }
 
-extern void SIM_WIFI_Transmit(size_t link_id, const char* expected)
+extern bool SIM_WIFI_ModuleGetVersion(uint32_t* at_version, uint32_t* sdk_version)
 {
-	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	auto& s = g_server_settings[link_id];
-	for (const char* cursor = expected; *cursor != 0; cursor++)
-		s.transmit_queue.push(*cursor);
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	if (!g_sim->has_version)
+		return false;
+	*at_version = g_sim->at_version;
+	*sdk_version = g_sim->sdk_version;
+	return true;
 }
 
-extern void SIM_WIFI_Receive(size_t link_id, const char* data)
+extern bool SIM_WIFI_ModuleNetworkConnect(const char* ssid, const char* password)
 {
-	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	std::string str(data);
-	SIM_AddInterrupt([=]() {
-		ASSERT(g_is_active);
-		ASSERT(g_is_network_connected || g_is_local_network_enabled);
-		ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-		auto& s = g_server_settings[link_id];
-		ASSERT(s.is_connected);
-		for (char c : str)
-			RLM3_WIFI_Receive_Callback(link_id, c);
-	});
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(!g_sim->is_network_connected);
+	if (!g_sim->has_network)
+		return false;
+	SIM_WIFI_VERIFY(ssid == g_sim->ssid);
+	SIM_WIFI_VERIFY(password == g_sim->password);
+	g_sim->is_network_connected = true;
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_UP, 0, SIM_WIFI_CaptureFlags(false));
+	return true;
 }
 
-extern void SIM_WIFI_Connect(size_t link_id)
+extern void SIM_WIFI_ModuleNetworkDisconnect()
+{
+	if (g_sim->is_fault_enabled && !g_sim->is_network_connected)
+		return;
+	SIM_WIFI_VERIFY(g_sim->is_network_connected);
+	g_sim->is_network_connected = false;
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_DOWN, 0, SIM_WIFI_CaptureFlags(false));
+	DropLinks();
+}
+
+extern bool SIM_WIFI_ModuleIsNetworkConnected()
+{
+	return g_sim->is_network_connected;
+}
+
+extern bool SIM_WIFI_ModuleServerConnect(size_t link_id, const char* server, const char* service)
 {
 	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	ASSERT(g_has_local_network);
-	SIM_AddInterrupt([=] {
-		ASSERT(g_is_active);
-		ASSERT(g_is_local_network_enabled);
-		auto& s = g_server_settings[link_id];
-		ASSERT(!s.is_connected);
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_network_connected);
+	auto& s = g_sim->server_settings[link_id];
+	SIM_WIFI_VERIFY(!s.is_connected);
+	if (!s.has_server)
+		return false;
+	SIM_WIFI_VERIFY(server == s.server);
+	SIM_WIFI_VERIFY(service == s.service);
+	bool is_local_connection = false;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.bridge_port != 0)
+		{
+			s.bridge_socket = OpenBridgeConnection(s.bridge_port);
+			if (s.bridge_socket < 0)
+				return false;
+		}
 		s.is_connected = true;
-		s.is_local_connection = true;
-		RLM3_WIFI_NetworkConnect_Callback(link_id, s.is_local_connection);
+		s.is_local_connection = is_local_connection;
+		s.stats.connect_count++;
+		s.stats.last_connect_time = RLM3_GetCurrentTime();
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_CONNECT, link_id, SIM_WIFI_CaptureFlags(is_local_connection));
+	}
+	SIM_DoInterrupt([=] {
+		NotifyConnect(link_id, is_local_connection);
 	});
+	ScheduleBridgePoll();
+	return true;
 }
 
-extern void SIM_WIFI_Disconnect(size_t link_id)
+extern void SIM_WIFI_ModuleServerDisconnect(size_t link_id)
 {
 	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
-	SIM_AddInterrupt([=] {
-		ASSERT(g_is_active);
-		ASSERT(g_is_network_connected || g_is_local_network_enabled);
-		auto& s = g_server_settings[link_id];
-		ASSERT(s.is_connected);
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	auto& s = g_sim->server_settings[link_id];
+	// Firmware cleaning up after an injected fault may disconnect a link that is already gone.
+	if (g_sim->is_fault_enabled && !s.is_connected)
+		return;
+	SIM_WIFI_VERIFY(g_sim->is_network_connected);
+	SIM_WIFI_VERIFY(s.is_connected);
+	bool is_local_connection;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
 		s.is_connected = false;
-		RLM3_WIFI_NetworkDisconnect_Callback(link_id, s.is_local_connection);
-	});
+		s.stats.disconnect_count++;
+		s.stats.last_disconnect_time = RLM3_GetCurrentTime();
+		CloseLink(s);
+		is_local_connection = s.is_local_connection;
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_DISCONNECT, link_id, SIM_WIFI_CaptureFlags(is_local_connection));
+	}
+	SIM_DoInterrupt([=] {
+		NotifyDisconnect(link_id, is_local_connection);
+	});
+}
+
+extern bool SIM_WIFI_ModuleIsServerConnected(size_t link_id)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	return s.is_connected;
+}
+
+extern bool SIM_WIFI_ModuleLocalNetworkEnable(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service)
+{
+	SIM_WIFI_VERIFY(!g_sim->is_local_network_enabled);
+	if (!g_sim->has_local_network)
+		return false;
+	SIM_WIFI_VERIFY(ssid == g_sim->local_ssid);
+	SIM_WIFI_VERIFY(password == g_sim->local_password);
+	SIM_WIFI_VERIFY(max_clients == g_sim->local_max_clients);
+	SIM_WIFI_VERIFY(ip_address == g_sim->local_ip_address);
+	SIM_WIFI_VERIFY(service == g_sim->local_service);
+	if (g_sim->local_bridge_port != 0)
+	{
+		g_sim->local_bridge_socket = OpenBridgeListener(g_sim->local_bridge_port);
+		if (g_sim->local_bridge_socket < 0)
+			return false;
+		ScheduleBridgePoll();
+	}
+	g_sim->is_local_network_enabled = true;
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_UP, 0, SIM_WIFI_CaptureFlags(true));
+	return true;
+}
+
+extern void SIM_WIFI_ModuleLocalNetworkDisable()
+{
+	SIM_WIFI_VERIFY(g_sim->is_local_network_enabled);
+	g_sim->is_local_network_enabled = false;
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_DOWN, 0, SIM_WIFI_CaptureFlags(true));
+	CloseLocalBridge();
+}
+
+extern bool SIM_WIFI_ModuleIsLocalNetworkEnabled()
+{
+	return g_sim->is_local_network_enabled;
+}
+
+static void DropNetwork()
+{
+	if (!g_sim->is_network_connected)
+		return;
+	g_sim->is_network_connected = false;
+	SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_NETWORK_DOWN, 0, SIM_WIFI_CaptureFlags(false, true));
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (!s.is_connected || s.is_local_connection)
+				continue;
+			s.is_connected = false;
+			s.stats.disconnect_count++;
+			s.stats.last_disconnect_time = RLM3_GetCurrentTime();
+			CloseLink(s);
+			SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_DISCONNECT, link_id, SIM_WIFI_CaptureFlags(false, true));
+		}
+		NotifyDisconnect(link_id, false);
+	}
+}
+
+static void InjectLinkFaults(size_t link_id)
+{
+	// Callers hold the link mutex.
+	auto& s = g_sim->server_settings[link_id];
+	const auto& faults = GetFaults(s);
+	if (RollFault(s, faults.disconnect))
+		AddLinkInterrupt(link_id, [link_id] { SIM_WIFI_DeliverDisconnect(link_id); });
+	if (!s.is_local_connection && RollFault(s, faults.network_drop))
+		AddSimInterrupt(DropNetwork);
+}
+
+static void RecordChurnResponse(ServerSettings& s)
+{
+	// Callers hold the link mutex.
+	if (!s.churn.is_client || s.churn.is_answered)
+		return;
+	RLM3_Time response = RLM3_GetCurrentTime() - s.churn.connect_time;
+	s.churn.is_answered = true;
+	s.churn.responses++;
+	s.churn.response_total += response;
+	s.churn.response_max = std::max(s.churn.response_max, response);
+}
+
+static bool HasTransmitInFlight(const ServerSettings& s)
+{
+	return s.transmit_in_flight_head < s.transmit_in_flight.size();
+}
+
+static bool HasTransmitUnclaimed(const ServerSettings& s)
+{
+	// In-flight data claims its expected bytes when it is accepted, so later sends cannot take them first.
+	return s.bridge_socket >= 0 || s.churn.is_client || s.transmit_pending > s.transmit_in_flight_bytes;
+}
+
+static RLM3_Time GetTransmitCompleteTime(ServerSettings& s, size_t size)
+{
+	// Sends serialize on the link at its bandwidth and then complete after the link latency, in order.
+	RLM3_Time start = std::max(RLM3_GetCurrentTime(), s.transmit_serial_time);
+	s.transmit_serial_time = start + ((s.bandwidth > 0) ? (RLM3_Time)((uint64_t)size * 1000 / s.bandwidth) : 0);
+	RLM3_Time complete_time = s.transmit_serial_time + s.latency;
+	if (HasTransmitInFlight(s))
+		complete_time = std::max(complete_time, s.transmit_in_flight.back().complete_time);
+	return complete_time;
+}
+
+static void AddTimedEvent(size_t link_id, RLM3_Time time, TimedEventType type, const uint8_t* data, size_t size, std::shared_ptr<const void> owner, std::shared_ptr<ReceiveStream> stream);
+
+static void AddTransmitInFlight(size_t link_id, ServerSettings& s, ServerSettings::InFlightTransmit transmit)
+{
+	// Callers hold the link mutex.
+	RLM3_Time complete_time = transmit.complete_time;
+	s.transmit_in_flight_bytes += transmit.size;
+	s.transmit_in_flight.push_back(std::move(transmit));
+	AddTimedEvent(link_id, complete_time, TIMED_TRANSMIT, nullptr, 0, nullptr, nullptr);
+}
+
+static bool TransmitSegments(size_t link_id, const RLM3_WIFI_Segment* segments, size_t segment_count, size_t SIM_WIFI_Stats::* calls, size_t SIM_WIFI_Stats::* bytes)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_network_connected || g_sim->is_local_network_enabled);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	SIM_WIFI_VERIFY(s.is_connected);
+	SIM_WIFI_VERIFY(segment_count > 0);
+	size_t size = 0;
+	for (size_t i = 0; i < segment_count; i++)
+	{
+		SIM_WIFI_VERIFY(segments[i].size > 0 && segments[i].size <= 1024);
+		size += segments[i].size;
+	}
+	SIM_WIFI_VERIFY(size <= 1024);
+	s.stats.*calls += 1;
+	if (g_sim->is_fault_enabled && RollFault(s, GetFaults(s).transmit_reject))
+		return false;
+	if (IsSendBufferFull(s, size))
+		return false;
+	bool is_queued = HasTransmitInFlight(s);
+	if (is_queued)
+	{
+		if (!HasTransmitUnclaimed(s))
+			return false;
+		ServerSettings::InFlightTransmit transmit = { {}, nullptr, size, GetTransmitCompleteTime(s, size) };
+		transmit.buffer.reserve(size);
+		for (size_t i = 0; i < segment_count; i++)
+			transmit.buffer.insert(transmit.buffer.end(), segments[i].data, segments[i].data + segments[i].size);
+		AddTransmitInFlight(link_id, s, std::move(transmit));
+	}
+	else if (s.bridge_socket >= 0)
+	{
+		for (size_t i = 0; i < segment_count; i++)
+			if (!BridgeSend(s, segments[i].data, segments[i].size))
+				return false;
+	}
+	else if (!s.churn.is_client)
+	{
+		if (!HasTransmitExpected(s))
+			return false;
+		for (size_t i = 0; i < segment_count; i++)
+			VerifyTransmit(link_id, s, segments[i].data, segments[i].size);
+	}
+	if (!is_queued)
+	{
+		RecordChurnResponse(s);
+		s.stats.last_transmit_time = RLM3_GetCurrentTime();
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_TRANSMIT, link_id, SIM_WIFI_CaptureFlags(s.is_local_connection), segments, segment_count);
+	}
+	AddSendBacklog(s, size);
+	s.stats.*bytes += size;
+	if (g_sim->is_fault_enabled)
+		InjectLinkFaults(link_id);
+	return true;
+}
+
+extern RLM3_WIFI_TransmitStatus SIM_WIFI_ModuleTransmitAsync(size_t link_id, const uint8_t* data, size_t size)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_network_connected || g_sim->is_local_network_enabled);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	SIM_WIFI_VERIFY(s.is_connected);
+	SIM_WIFI_VERIFY(size > 0 && size <= 1024);
+	s.stats.transmit_async_calls++;
+	if (s.transmit_in_flight_count >= s.transmit_window || IsSendBufferFull(s, size))
+	{
+		s.stats.transmit_busy_count++;
+		return RLM3_WIFI_TRANSMIT_BUSY;
+	}
+	if (g_sim->is_fault_enabled && RollFault(s, GetFaults(s).transmit_reject))
+		return RLM3_WIFI_TRANSMIT_FAILED;
+	if (!HasTransmitUnclaimed(s))
+		return RLM3_WIFI_TRANSMIT_FAILED;
+	AddTransmitInFlight(link_id, s, { {}, data, size, GetTransmitCompleteTime(s, size) });
+	s.transmit_in_flight_count++;
+	s.stats.transmit_in_flight_high_water = std::max(s.stats.transmit_in_flight_high_water, s.transmit_in_flight_count);
+	AddSendBacklog(s, size);
+	return RLM3_WIFI_TRANSMIT_OK;
+}
+
+static void CompleteTransmits(size_t link_id)
+{
+	auto& s = g_sim->server_settings[link_id];
+	RLM3_Time now = RLM3_GetCurrentTime();
+	size_t completed = 0;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		while (HasTransmitInFlight(s) && s.transmit_in_flight[s.transmit_in_flight_head].complete_time <= now)
+		{
+			auto& transmit = s.transmit_in_flight[s.transmit_in_flight_head++];
+			s.transmit_in_flight_bytes -= transmit.size;
+			if (s.bridge_socket >= 0)
+				BridgeSend(s, transmit.data(), transmit.size);
+			else if (!s.churn.is_client)
+				VerifyTransmit(link_id, s, transmit.data(), transmit.size);
+			RecordChurnResponse(s);
+			s.stats.last_transmit_time = now;
+			SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_TRANSMIT, link_id, SIM_WIFI_CaptureFlags(s.is_local_connection), transmit.data(), transmit.size);
+			// Queued blocking transmits already reported success and their stats when they were made.
+			if (transmit.external == nullptr)
+				continue;
+			s.stats.transmit_async_bytes += transmit.size;
+			s.transmit_in_flight_count--;
+			completed++;
+		}
+		if (!HasTransmitInFlight(s))
+		{
+			s.transmit_in_flight.clear();
+			s.transmit_in_flight_head = 0;
+		}
+	}
+	for (size_t i = 0; i < completed; i++)
+		NotifyTransmitComplete(link_id);
+}
+
+extern bool SIM_WIFI_ModuleTransmit(size_t link_id, const uint8_t* data, size_t size)
+{
+	RLM3_WIFI_Segment segment = { data, size };
+	return TransmitSegments(link_id, &segment, 1, &SIM_WIFI_Stats::transmit_calls, &SIM_WIFI_Stats::transmit_bytes);
+}
+
+extern bool SIM_WIFI_ModuleTransmit2(size_t link_id, const uint8_t* data_a, size_t size_a, const uint8_t* data_b, size_t size_b)
+{
+	RLM3_WIFI_Segment segments[2] = { { data_a, size_a }, { data_b, size_b } };
+	return TransmitSegments(link_id, segments, 2, &SIM_WIFI_Stats::transmit2_calls, &SIM_WIFI_Stats::transmit2_bytes);
+}
+
+extern bool SIM_WIFI_ModuleTransmitV(size_t link_id, const RLM3_WIFI_Segment* segments, size_t segment_count)
+{
+	return TransmitSegments(link_id, segments, segment_count, &SIM_WIFI_Stats::transmitv_calls, &SIM_WIFI_Stats::transmitv_bytes);
+}
+
+extern void SIM_WIFI_ModuleSetReceiveRing(size_t link_id, uint8_t* buffer, size_t size)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT((buffer == nullptr) == (size == 0));
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.ring = buffer;
+	s.ring_size = size;
+	s.ring_read = 0;
+	s.ring_count = 0;
+}
+
+extern size_t SIM_WIFI_ModuleReceiveAcquire(size_t link_id, const uint8_t** data)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT(data != nullptr);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	SIM_WIFI_VERIFY(s.ring != nullptr);
+	// Only the run up to the end of the buffer is contiguous; the wrapped part follows once it is released.
+	*data = s.ring + s.ring_read;
+	return std::min(s.ring_count, s.ring_size - s.ring_read);
+}
+
+extern void SIM_WIFI_ModuleReceiveRelease(size_t link_id, size_t size)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	SIM_WIFI_VERIFY(s.ring != nullptr);
+	SIM_WIFI_VERIFY(size <= std::min(s.ring_count, s.ring_size - s.ring_read));
+	s.ring_read = (s.ring_read + size) % s.ring_size;
+	s.ring_count -= size;
+}
+
+#ifndef RLM3_WIFI_SIM_AT
+
+extern bool RLM3_WIFI_Init()
+{
+	return SIM_WIFI_ModuleInit();
+}
+
+extern void RLM3_WIFI_Deinit()
+{
+	SIM_WIFI_ModuleDeinit();
+}
+
+extern bool RLM3_WIFI_IsInit()
+{
+	return SIM_WIFI_ModuleIsInit();
+}
+
+extern bool RLM3_WIFI_GetVersion(uint32_t* at_version, uint32_t* sdk_version)
+{
+	return SIM_WIFI_ModuleGetVersion(at_version, sdk_version);
+}
+
+extern bool RLM3_WIFI_NetworkConnect(const char* ssid, const char* password)
+{
+	return SIM_WIFI_ModuleNetworkConnect(ssid, password);
+}
+
+extern void RLM3_WIFI_NetworkDisconnect()
+{
+	SIM_WIFI_ModuleNetworkDisconnect();
+}
+
+extern bool RLM3_WIFI_IsNetworkConnected()
+{
+	return SIM_WIFI_ModuleIsNetworkConnected();
+}
+
+extern bool RLM3_WIFI_ServerConnect(size_t link_id, const char* server, const char* service)
+{
+	return SIM_WIFI_ModuleServerConnect(link_id, server, service);
+}
+
+extern void RLM3_WIFI_ServerDisconnect(size_t link_id)
+{
+	SIM_WIFI_ModuleServerDisconnect(link_id);
+}
+
+extern bool RLM3_WIFI_IsServerConnected(size_t link_id)
+{
+	return SIM_WIFI_ModuleIsServerConnected(link_id);
+}
+
+extern bool RLM3_WIFI_LocalNetworkEnable(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service)
+{
+	return SIM_WIFI_ModuleLocalNetworkEnable(ssid, password, max_clients, ip_address, service);
+}
+
+extern void RLM3_WIFI_LocalNetworkDisable()
+{
+	SIM_WIFI_ModuleLocalNetworkDisable();
+}
+
+extern bool RLM3_WIFI_IsLocalNetworkEnabled()
+{
+	return SIM_WIFI_ModuleIsLocalNetworkEnabled();
+}
+
+extern bool RLM3_WIFI_Transmit(size_t link_id, const uint8_t* data, size_t size)
+{
+	return SIM_WIFI_ModuleTransmit(link_id, data, size);
+}
+
+extern bool RLM3_WIFI_Transmit2(size_t link_id, const uint8_t* data_a, size_t size_a, const uint8_t* data_b, size_t size_b)
+{
+	return SIM_WIFI_ModuleTransmit2(link_id, data_a, size_a, data_b, size_b);
+}
+
+extern bool RLM3_WIFI_TransmitV(size_t link_id, const RLM3_WIFI_Segment* segments, size_t segment_count)
+{
+	return SIM_WIFI_ModuleTransmitV(link_id, segments, segment_count);
+}
+
+extern RLM3_WIFI_TransmitStatus RLM3_WIFI_TransmitAsync(size_t link_id, const uint8_t* data, size_t size)
+{
+	return SIM_WIFI_ModuleTransmitAsync(link_id, data, size);
+}
+
+extern void RLM3_WIFI_SetReceiveRing(size_t link_id, uint8_t* buffer, size_t size)
+{
+	SIM_WIFI_ModuleSetReceiveRing(link_id, buffer, size);
+}
+
+extern size_t RLM3_WIFI_ReceiveAcquire(size_t link_id, const uint8_t** data)
+{
+	return SIM_WIFI_ModuleReceiveAcquire(link_id, data);
+}
+
+extern void RLM3_WIFI_ReceiveRelease(size_t link_id, size_t size)
+{
+	SIM_WIFI_ModuleReceiveRelease(link_id, size);
+}
+extern __attribute__((weak)) void RLM3_WIFI_Receive_Callback(size_t link_id, uint8_t data)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
+
+extern __attribute__((weak)) void RLM3_WIFI_ReceiveBlock_Callback(size_t link_id, const uint8_t* data, size_t size)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+	// Applications that do not handle blocks receive the data one byte at a time.
+	for (size_t i = 0; i < size; i++)
+		RLM3_WIFI_Receive_Callback(link_id, data[i]);
+}
+
+extern __attribute__((weak)) void RLM3_WIFI_NetworkConnect_Callback(size_t link_id, bool local_connection)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
+
+extern __attribute__((weak)) void RLM3_WIFI_NetworkDisconnect_Callback(size_t link_id, bool local_connection)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
+
+extern __attribute__((weak)) void RLM3_WIFI_TransmitComplete_Callback(size_t link_id)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
+
+extern __attribute__((weak)) void RLM3_WIFI_ReceiveReady_Callback(size_t link_id)
+{
+	// DO NOT MODIFIY THIS FUNCTION.  Override it by declaring a non-weak version in your project files.
+}
+
+#endif
+
+
+extern void SIM_WIFI_DeliverReceive(size_t link_id, const uint8_t* data, size_t size)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	// Injected faults may have closed the link under scripted traffic; that data is lost.
+	if (g_sim->is_fault_enabled && !s.is_connected)
+		return;
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_network_connected || g_sim->is_local_network_enabled);
+	SIM_WIFI_VERIFY(s.is_connected);
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.stats.receive_bytes += size;
+		s.stats.last_receive_time = RLM3_GetCurrentTime();
+		s.stats.receive_callbacks++;
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_RECEIVE, link_id, SIM_WIFI_CaptureFlags(s.is_local_connection, true), data, size);
+		if (g_sim->is_fault_enabled)
+			InjectLinkFaults(link_id);
+	}
+	// The callback runs unlocked so it may transmit on the same link.
+	NotifyReceive(link_id, data, size);
+}
+
+extern void SIM_WIFI_DeliverConnect(size_t link_id)
+{
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_local_network_enabled);
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	SIM_WIFI_VERIFY(!s.is_connected);
+	SIM_WIFI_VERIFY(CountLocalClients() < g_sim->local_max_clients);
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.is_connected = true;
+		s.is_local_connection = true;
+		s.stats.connect_count++;
+		s.stats.last_connect_time = RLM3_GetCurrentTime();
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_CONNECT, link_id, SIM_WIFI_CaptureFlags(true, true));
+	}
+	NotifyConnect(link_id, true);
+}
+
+extern void SIM_WIFI_DeliverDisconnect(size_t link_id)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	if (g_sim->is_fault_enabled && !s.is_connected)
+		return;
+	SIM_WIFI_VERIFY(g_sim->is_active);
+	SIM_WIFI_VERIFY(g_sim->is_network_connected || g_sim->is_local_network_enabled);
+	SIM_WIFI_VERIFY(s.is_connected);
+	bool is_local_connection;
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.is_connected = false;
+		s.stats.disconnect_count++;
+		s.stats.last_disconnect_time = RLM3_GetCurrentTime();
+		CloseLink(s);
+		is_local_connection = s.is_local_connection;
+		SIM_WIFI_CaptureEvent(SIM_WIFI_CAPTURE_DISCONNECT, link_id, SIM_WIFI_CaptureFlags(is_local_connection, true));
+	}
+	NotifyDisconnect(link_id, is_local_connection);
+}
+
+
+extern SIM_WIFI_Instance* SIM_WIFI_CreateInstance()
+{
+	WifiSim* sim = new WifiSim();
+	WifiSim* previous = g_sim;
+	g_sim = sim;
+	ResetSim();
+	g_sim = previous;
+	return sim;
+}
+
+extern void SIM_WIFI_DestroyInstance(SIM_WIFI_Instance* instance)
+{
+	ASSERT(instance != nullptr && instance != &g_default_sim);
+	// Interrupts queued for the instance would run against freed state.
+	ASSERT(instance->pending_interrupts == 0);
+	WifiSim* previous = (g_sim == instance) ? &g_default_sim : g_sim;
+	g_sim = instance;
+	CloseSim();
+	g_sim = previous;
+	delete instance;
+}
+
+static void QueueTimedPump(RLM3_Time time);
+
+static bool IsSimQuiet(const WifiSim& sim)
+{
+	// Only timed event pumps may be queued.  Other interrupts hold state in the base simulator queue.
+	return sim.pending_interrupts == sim.timed_pumps_queued && sim.local_bridge_socket < 0;
+}
+
+static void CopySim(WifiSim& to, const WifiSim& from, RLM3_Time shift)
+{
+	to.fail_init = from.fail_init;
+	to.is_active = from.is_active.load();
+	to.has_version = from.has_version;
+	to.at_version = from.at_version;
+	to.sdk_version = from.sdk_version;
+	to.has_network = from.has_network;
+	to.ssid = from.ssid;
+	to.password = from.password;
+	to.is_network_connected = from.is_network_connected.load();
+	to.has_local_network = from.has_local_network;
+	to.local_ssid = from.local_ssid;
+	to.local_password = from.local_password;
+	to.local_max_clients = from.local_max_clients;
+	to.local_ip_address = from.local_ip_address;
+	to.local_service = from.local_service;
+	to.is_local_network_enabled = from.is_local_network_enabled.load();
+	to.receive_chunk_size = from.receive_chunk_size;
+	to.faults = from.faults;
+	to.is_fault_enabled = from.is_fault_enabled;
+	to.timed_events = from.timed_events;
+	to.timed_sequence = from.timed_sequence;
+	to.local_bridge_port = from.local_bridge_port;
+	to.churn = from.churn;
+	// Link model, churn and event times move with the clock so the copy resumes with the same relative timing.
+	to.churn.next_connect_time += shift;
+	for (auto& event : to.timed_events)
+		event.time += shift;
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = to.server_settings[link_id];
+		s = from.server_settings[link_id];
+		s.send_update_time += shift;
+		s.transmit_serial_time += shift;
+		s.receive_serial_time += shift;
+		s.receive_arrival_time += shift;
+		s.coalesce_first_time += shift;
+		s.coalesce_last_time += shift;
+		s.churn.connect_time += shift;
+		s.churn.end_time += shift;
+	}
+}
+
+extern SIM_WIFI_Instance* SIM_WIFI_Snapshot()
+{
+	WifiSim& sim = *g_sim;
+	ASSERT(IsSimQuiet(sim));
+	for (auto& s : sim.server_settings)
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		ASSERT(s.bridge_socket < 0);
+		// In-flight transmits point at firmware buffers that will not exist when the snapshot is restored.
+		ASSERT(!HasTransmitInFlight(s));
+		// So does a receive ring, and data in it belongs to the firmware that owns it.
+		ASSERT(s.ring == nullptr);
+	}
+	// A stream is read as it arrives, so two instances cannot share one.  Timers belong to scenarios and
+	// replays, which are process-wide.
+	for (auto& event : sim.timed_events)
+		ASSERT(event.stream == nullptr && !event.callback);
+	WifiSim* snapshot = new WifiSim();
+	snapshot->pending_interrupts = 0;
+	snapshot->is_timed_pump_scheduled = false;
+	snapshot->is_bridge_poll_scheduled = false;
+	snapshot->snapshot_time = RLM3_GetCurrentTime();
+	CopySim(*snapshot, sim, 0);
+	return snapshot;
+}
+
+extern void SIM_WIFI_Restore(const SIM_WIFI_Instance* snapshot)
+{
+	ASSERT(snapshot != nullptr && snapshot != g_sim);
+	WifiSim& sim = *g_sim;
+	ASSERT(IsSimQuiet(sim));
+	CloseSim();
+	CopySim(sim, *snapshot, RLM3_GetCurrentTime() - snapshot->snapshot_time);
+	// The restored events may be due before the wait the instance has armed.
+	if (!sim.timed_events.empty())
+	{
+		std::lock_guard<std::mutex> lock(sim.schedule_mutex);
+		QueueTimedPump(RLM3_GetCurrentTime());
+	}
+}
+
+extern void SIM_WIFI_SelectInstance(SIM_WIFI_Instance* instance)
+{
+	g_sim = (instance != nullptr) ? instance : &g_default_sim;
+}
+
+extern SIM_WIFI_Instance* SIM_WIFI_GetInstance()
+{
+	return g_sim;
+}
+
+extern void SIM_WIFI_InitFailure()
+{
+	g_sim->fail_init = true;
+}
+
+extern void SIM_WIFI_SetVersion(uint32_t at_version, uint32_t sdk_version)
+{
+	g_sim->has_version = true;
+	g_sim->at_version = at_version;
+	g_sim->sdk_version = sdk_version;
+}
+
+extern void SIM_WIFI_SetNetwork(const char* ssid, const char* password)
+{
+	g_sim->has_network = true;
+	g_sim->ssid = ssid;
+	g_sim->password = password;
+}
+
+extern void SIM_WIFI_SetLocalNetwork(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service)
+{
+	g_sim->has_local_network = true;
+	g_sim->local_ssid = ssid;
+	g_sim->local_password = password;
+	g_sim->local_max_clients = max_clients;
+	g_sim->local_ip_address = ip_address;
+	g_sim->local_service = service;
+}
+
+extern void SIM_WIFI_SetServer(size_t link_id, const char* server, const char* service)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	s.has_server = true;
+	s.server = server;
+	s.service = service;
+}
+
+extern void SIM_WIFI_SetServerBridge(size_t link_id, const char* server, const char* service, uint16_t port)
+{
+	// Connecting to this server opens a TCP connection to 127.0.0.1:port instead of using scripted data.
+	SIM_WIFI_SetServer(link_id, server, service);
+	g_sim->server_settings[link_id].bridge_port = port;
+}
+
+extern void SIM_WIFI_SetLocalNetworkBridge(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service, uint16_t port)
+{
+	// Enabling this network listens on 127.0.0.1:port and maps each accepted client to a free link.
+	SIM_WIFI_SetLocalNetwork(ssid, password, max_clients, ip_address, service);
+	g_sim->local_bridge_port = port;
+}
+
+extern void SIM_WIFI_SetLinkModel(size_t link_id, uint32_t bytes_per_second, RLM3_Time latency, RLM3_Time jitter, size_t send_buffer_size)
+{
+	// Receive timing is computed when data is scheduled, so set the model before calling SIM_WIFI_Receive.
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	s.bandwidth = bytes_per_second;
+	s.latency = latency;
+	s.jitter = jitter;
+	s.send_buffer_size = send_buffer_size;
+	s.send_backlog = 0;
+	s.send_update_time = RLM3_GetCurrentTime();
+	s.receive_remainder = 0;
+	s.receive_serial_time = s.send_update_time;
+	s.receive_arrival_time = s.send_update_time;
+}
+
+extern void SIM_WIFI_Transmit(size_t link_id, const char* expected)
+{
+	AddTransmitExpected(link_id, (const uint8_t*)expected, std::strlen(expected), true, nullptr);
+}
+
+extern void SIM_WIFI_TransmitBytes(size_t link_id, const uint8_t* expected, size_t size)
+{
+	AddTransmitExpected(link_id, expected, size, true, nullptr);
+}
+
+extern void SIM_WIFI_TransmitRef(size_t link_id, const uint8_t* expected, size_t size)
+{
+	// The caller's buffer is compared in place and must stay valid until the transmit is verified.
+	AddTransmitExpected(link_id, expected, size, false, nullptr);
+}
+
+extern void SIM_WIFI_TransmitShared(size_t link_id, const uint8_t* expected, size_t size, std::shared_ptr<const void> owner)
+{
+	AddTransmitExpected(link_id, expected, size, false, std::move(owner));
+}
+
+extern void SIM_WIFI_TransmitCrc32(size_t link_id, size_t size, uint32_t crc)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT(size > 0);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	ReserveTransmitExpected(s, size);
+	s.transmit_expected.push_back({ {}, nullptr, size, 0, true, 0, crc });
+}
+
+extern uint32_t SIM_WIFI_Crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+	const uint32_t* table = GetCrc32Table();
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+extern void SIM_WIFI_Receive(size_t link_id, const char* data)
+{
+	SIM_WIFI_ReceiveBytes(link_id, (const uint8_t*)data, std::strlen(data));
+}
+
+extern void SIM_WIFI_ReceiveBytes(size_t link_id, const uint8_t* data, size_t size)
+{
+	auto owner = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+	AddReceive(link_id, owner->data(), owner->size(), owner);
+}
+
+extern void SIM_WIFI_ReceiveRef(size_t link_id, const uint8_t* data, size_t size)
+{
+	// The caller's buffer is delivered in place and must stay valid until the receive interrupt runs.
+	AddReceive(link_id, data, size, nullptr);
+}
+
+extern void SIM_WIFI_ReceiveShared(size_t link_id, const uint8_t* data, size_t size, std::shared_ptr<const void> owner)
+{
+	AddReceive(link_id, data, size, std::move(owner));
+}
+
+extern void SIM_WIFI_ReceiveStream(size_t link_id, SIM_WIFI_ReceiveSource source, void* context)
+{
+	// The source is called from interrupt context with the link locked and returns 0 at the end of the stream.
+	ASSERT(source != nullptr);
+	auto stream = std::make_shared<ReceiveStream>();
+	stream->source = source;
+	stream->context = context;
+	stream->file = nullptr;
+	AddReceiveStream(link_id, stream);
+}
+
+extern bool SIM_WIFI_ReceiveFile(size_t link_id, const char* path)
+{
+	std::FILE* file = std::fopen(path, "rb");
+	if (file == nullptr)
+	{
+		LOG_ERROR("WIFI receive file %s could not be opened: %s", path, std::strerror(errno));
+		return false;
+	}
+	auto stream = std::make_shared<ReceiveStream>();
+	stream->source = ReadReceiveFile;
+	stream->context = file;
+	stream->file = file;
+	AddReceiveStream(link_id, stream);
+	return true;
+}
+
+extern void SIM_WIFI_SetCoalescing(size_t link_id, const SIM_WIFI_Coalesce* coalesce)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	ASSERT(s.coalesce_buffer.empty());
+	s.has_coalesce = (coalesce != nullptr);
+	s.coalesce = s.has_coalesce ? *coalesce : SIM_WIFI_Coalesce();
+	// Without a burst size, leftover data needs a timer to ever be delivered.
+	ASSERT(!s.has_coalesce || s.coalesce.idle_timeout > 0 || s.coalesce.max_latency > 0 || s.coalesce.burst_size > 0);
+}
+
+extern void SIM_WIFI_SetTransmitWindow(size_t link_id, size_t buffers)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT(buffers > 0);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.transmit_window = buffers;
+}
+
+extern void SIM_WIFI_SetReceiveChunkSize(size_t chunk_size)
+{
+	g_sim->receive_chunk_size = chunk_size;
+}
+
+extern void SIM_WIFI_Connect(size_t link_id)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT(g_sim->has_local_network);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	// Modelled receives wait in the timed heap, so the connect waits there too to stay behind them.
+	if (HasLinkModel(s))
+	{
+		AddTimedEvent(link_id, std::max(RLM3_GetCurrentTime(), s.receive_arrival_time), TIMED_CONNECT, nullptr, 0, nullptr, nullptr);
+		return;
+	}
+	AddLinkInterrupt(link_id, [=] {
+		SIM_WIFI_DeliverConnect(link_id);
+	});
+}
+
+extern void SIM_WIFI_Disconnect(size_t link_id)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (HasLinkModel(s))
+	{
+		AddTimedEvent(link_id, std::max(RLM3_GetCurrentTime(), s.receive_arrival_time), TIMED_DISCONNECT, nullptr, 0, nullptr, nullptr);
+		return;
+	}
+	AddLinkInterrupt(link_id, [=] {
+		SIM_WIFI_DeliverDisconnect(link_id);
+	});
+}
+
+static void RunChurn();
+
+static void RunTimedEvents(uint32_t generation)
+{
+	// Fires every event that is due, then waits on the base simulator clock for the earliest one left.
+	// Events are popped one at a time under the schedule mutex and run without it, since they take link
+	// mutexes and may schedule more events.  The running pump stays current so those do not queue another.
+	{
+		std::lock_guard<std::mutex> lock(g_sim->schedule_mutex);
+		g_sim->timed_pumps_queued--;
+		if (generation != g_sim->timed_pump_generation)
+			return;
+	}
+	RLM3_Time now = RLM3_GetCurrentTime();
+	bool has_fired = false;
+	while (true)
+	{
+		TimedEvent event;
+		{
+			std::lock_guard<std::mutex> lock(g_sim->schedule_mutex);
+			if (g_sim->timed_events.empty() || g_sim->timed_events.front().time > now)
+				break;
+			std::pop_heap(g_sim->timed_events.begin(), g_sim->timed_events.end(), std::greater<TimedEvent>());
+			event = std::move(g_sim->timed_events.back());
+			g_sim->timed_events.pop_back();
+		}
+		has_fired = true;
+		size_t link_id = event.link_id;
+		auto& s = g_sim->server_settings[link_id];
+		switch (event.type)
+		{
+		case TIMED_RECEIVE:
+			AddReceive(link_id, event.data, event.size, event.owner);
+			break;
+		case TIMED_ARRIVE:
+		case TIMED_ARRIVE_STREAM:
+			{
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.pending_interrupts--;
+			}
+			if (event.type == TIMED_ARRIVE)
+				ArriveReceive(link_id, event.data, event.size);
+			else
+				ArriveReceiveStream(link_id, event.stream, event.size);
+			break;
+		case TIMED_COALESCE:
+			RunCoalesceTimer(link_id);
+			break;
+		case TIMED_TRANSMIT:
+			CompleteTransmits(link_id);
+			break;
+		case TIMED_CONNECT:
+		case TIMED_DISCONNECT:
+			{
+				// Data scripted before the event is still crossing the link model, so the event follows it.
+				std::lock_guard<std::mutex> lock(s.mutex);
+				if (s.receive_arrival_time > now)
+					AddTimedEvent(link_id, s.receive_arrival_time, event.type, nullptr, 0, nullptr, nullptr);
+				else if (event.type == TIMED_CONNECT)
+					AddLinkInterrupt(link_id, [link_id] { SIM_WIFI_DeliverConnect(link_id); });
+				else
+					AddLinkInterrupt(link_id, [link_id] { SIM_WIFI_DeliverDisconnect(link_id); });
+			}
+			break;
+		case TIMED_CHURN:
+			RunChurn();
+			break;
+		case TIMED_CALLBACK:
+			event.callback();
+			break;
+		}
+	}
+	std::lock_guard<std::mutex> lock(g_sim->schedule_mutex);
+	if (g_sim->timed_events.empty())
+	{
+		g_sim->is_timed_pump_scheduled = false;
+		return;
+	}
+	// A wait in the base queue cannot be cut short, so after firing the pump first goes to the back of the
+	// queue.  The interrupts those events queued run before the wait is armed, and any event they add is
+	// in the heap when the wait is chosen.
+	QueueTimedPump(has_fired ? now : g_sim->timed_events.front().time);
+}
+
+static void QueueTimedPump(RLM3_Time time)
+{
+	// Callers hold the schedule mutex.  The new pump replaces any pump already queued.
+	RLM3_Time now = RLM3_GetCurrentTime();
+	uint32_t generation = ++g_sim->timed_pump_generation;
+	g_sim->is_timed_pump_scheduled = true;
+	g_sim->timed_pump_time = std::max(time, now);
+	g_sim->timed_pumps_queued++;
+	if (time > now)
+		SIM_AddDelay(time - now);
+	AddSimInterruptLocked([generation]() { RunTimedEvents(generation); });
+}
+
+static void PushTimedEvent(TimedEvent event)
+{
+	ASSERT(event.link_id < RLM3_WIFI_LINK_COUNT);
+	std::lock_guard<std::mutex> lock(g_sim->schedule_mutex);
+	event.sequence = g_sim->timed_sequence++;
+	RLM3_Time time = event.time;
+	g_sim->timed_events.push_back(std::move(event));
+	std::push_heap(g_sim->timed_events.begin(), g_sim->timed_events.end(), std::greater<TimedEvent>());
+	// The first pump runs once the test blocks, so every event scheduled during setup is in the heap by then.
+	// An event due before the armed wait gets a pump of its own that chooses the wait again.
+	if (!g_sim->is_timed_pump_scheduled || time < g_sim->timed_pump_time)
+		QueueTimedPump(RLM3_GetCurrentTime());
+}
+
+static void AddTimedEvent(size_t link_id, RLM3_Time time, TimedEventType type, const uint8_t* data, size_t size, std::shared_ptr<const void> owner, std::shared_ptr<ReceiveStream> stream)
+{
+	PushTimedEvent({ time, 0, type, link_id, data, size, std::move(owner), std::move(stream), nullptr });
+}
+
+extern void SIM_WIFI_AddInterrupt(std::function<void()> interrupt)
+{
+	AddSimInterrupt(std::move(interrupt));
+}
+
+extern void SIM_WIFI_AddTimer(RLM3_Time time, std::function<void()> callback)
+{
+	PushTimedEvent({ time, 0, TIMED_CALLBACK, 0, nullptr, 0, nullptr, nullptr, std::move(callback) });
+}
+
+extern void SIM_WIFI_ReceiveAt(size_t link_id, RLM3_Time time, const char* data)
+{
+	SIM_WIFI_ReceiveBytesAt(link_id, time, (const uint8_t*)data, std::strlen(data));
+}
+
+extern void SIM_WIFI_ReceiveBytesAt(size_t link_id, RLM3_Time time, const uint8_t* data, size_t size)
+{
+	auto owner = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+	AddTimedEvent(link_id, time, TIMED_RECEIVE, owner->data(), owner->size(), owner, nullptr);
+}
+
+extern void SIM_WIFI_ConnectAt(size_t link_id, RLM3_Time time)
+{
+	ASSERT(g_sim->has_local_network);
+	AddTimedEvent(link_id, time, TIMED_CONNECT, nullptr, 0, nullptr, nullptr);
+}
+
+extern void SIM_WIFI_DisconnectAt(size_t link_id, RLM3_Time time)
+{
+	AddTimedEvent(link_id, time, TIMED_DISCONNECT, nullptr, 0, nullptr, nullptr);
+}
+
+static RLM3_Time GetChurnInterval(RLM3_Time mean)
+{
+	if (mean < 2)
+		return std::max<RLM3_Time>(mean, 1);
+	return mean / 2 + NextRandom(g_sim->churn.random_state) % mean;
+}
+
+template <typename F>
+static void TimeChurnCallback(F deliver)
+{
+	auto start = std::chrono::steady_clock::now();
+	deliver();
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	g_sim->churn.callback_ns += ns;
+	g_sim->churn.callback_max_ns = std::max(g_sim->churn.callback_max_ns, ns);
+}
+
+static void ConnectChurnClient(RLM3_Time now)
+{
+	auto& churn = g_sim->churn;
+	size_t client_count = CountLocalClients();
+	// Like the ESP module, a new client takes the lowest free link.
+	size_t link_id = 0;
+	while (link_id < RLM3_WIFI_LINK_COUNT && g_sim->server_settings[link_id].is_connected)
+		link_id++;
+	if (client_count >= g_sim->local_max_clients || link_id >= RLM3_WIFI_LINK_COUNT)
+	{
+		churn.deferred_connects++;
+		return;
+	}
+	auto& s = g_sim->server_settings[link_id];
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.churn.is_client = true;
+		s.churn.is_answered = false;
+		s.churn.connect_time = now;
+		s.churn.end_time = now + GetChurnInterval(churn.config.session_time);
+		s.churn.sessions++;
+	}
+	churn.sessions_started++;
+	churn.peak_clients = std::max(churn.peak_clients, client_count + 1);
+	TimeChurnCallback([link_id] { SIM_WIFI_DeliverConnect(link_id); });
+	if (churn.data && s.is_connected)
+		AddReceive(link_id, churn.data->data(), churn.data->size(), churn.data);
+}
+
+static void RunChurn()
+{
+	// Ends due sessions, makes at most one connect attempt, then waits for the next session end or attempt.
+	auto& churn = g_sim->churn;
+	churn.is_pump_scheduled = false;
+	if (!churn.is_active)
+		return;
+	RLM3_Time now = RLM3_GetCurrentTime();
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		if (!s.churn.is_client || s.churn.end_time > now)
+			continue;
+		s.churn.is_client = false;
+		if (s.is_connected)
+			TimeChurnCallback([link_id] { SIM_WIFI_DeliverDisconnect(link_id); });
+	}
+	bool has_clients_left = churn.sessions_started < churn.config.client_count;
+	if (has_clients_left && churn.next_connect_time <= now)
+	{
+		if (g_sim->is_active && g_sim->is_local_network_enabled)
+			ConnectChurnClient(now);
+		churn.next_connect_time = now + GetChurnInterval(churn.config.connect_interval);
+		has_clients_left = churn.sessions_started < churn.config.client_count;
+	}
+
+	bool has_next = has_clients_left;
+	RLM3_Time next = churn.next_connect_time;
+	for (auto& s : g_sim->server_settings)
+	{
+		if (!s.churn.is_client)
+			continue;
+		if (!has_next || s.churn.end_time < next)
+			next = s.churn.end_time;
+		has_next = true;
+	}
+	if (!has_next)
+	{
+		churn.is_active = false;
+		return;
+	}
+	churn.is_pump_scheduled = true;
+	AddTimedEvent(0, next, TIMED_CHURN, nullptr, 0, nullptr, nullptr);
+}
+
+extern void SIM_WIFI_StartChurn(const SIM_WIFI_Churn* churn)
+{
+	ASSERT(churn != nullptr);
+	ASSERT(g_sim->has_local_network);
+	ASSERT(churn->receive_size <= 1024);
+	auto& state = g_sim->churn;
+	state.is_active = true;
+	state.config = *churn;
+	state.sessions_started = 0;
+	state.next_connect_time = RLM3_GetCurrentTime();
+	state.random_state = GetLinkSeed(0x2468ACE0, RLM3_WIFI_LINK_COUNT);
+	state.data = nullptr;
+	if (churn->receive_size > 0)
+	{
+		auto data = std::make_shared<std::vector<uint8_t>>(churn->receive_size);
+		for (size_t i = 0; i < data->size(); i++)
+			(*data)[i] = (uint8_t)('a' + i % 26);
+		state.data = data;
+	}
+	if (!state.is_pump_scheduled)
+	{
+		state.is_pump_scheduled = true;
+		AddSimInterrupt(RunChurn);
+	}
+}
+
+extern bool SIM_WIFI_IsChurnActive()
+{
+	return g_sim->churn.is_active;
+}
+
+extern void SIM_WIFI_GetChurnStats(SIM_WIFI_ChurnStats* stats)
+{
+	ASSERT(stats != nullptr);
+	const auto& churn = g_sim->churn;
+	*stats = {};
+	stats->deferred_connects = churn.deferred_connects;
+	stats->peak_clients = churn.peak_clients;
+	stats->callback_ns = churn.callback_ns;
+	stats->callback_max_ns = churn.callback_max_ns;
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		std::lock_guard<std::mutex> lock(s.mutex);
+		stats->sessions += s.churn.sessions;
+		stats->responses += s.churn.responses;
+		stats->response_total += s.churn.response_total;
+		stats->response_max = std::max(stats->response_max, s.churn.response_max);
+		stats->link_sessions[link_id] = s.churn.sessions;
+		stats->link_responses[link_id] = s.churn.responses;
+	}
+}
+
+extern void SIM_WIFI_GetStats(size_t link_id, SIM_WIFI_Stats* stats)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	std::lock_guard<std::mutex> lock(s.mutex);
+	*stats = s.stats;
+}
+
+extern void SIM_WIFI_ResetStats()
+{
+	for (auto& s : g_sim->server_settings)
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.stats = {};
+		s.stats.transmit_pending_high_water = s.transmit_pending;
+		s.stats.pending_interrupt_high_water = s.pending_interrupts;
+	}
+}
+
+static bool HasFaults(const SIM_WIFI_Faults& faults)
+{
+	return faults.transmit_reject > 0.0 || faults.receive_fragment > 0.0 || faults.disconnect > 0.0 || faults.network_drop > 0.0;
+}
+
+static void UpdateFaultEnabled()
+{
+	g_sim->is_fault_enabled = HasFaults(g_sim->faults);
+	for (auto& s : g_sim->server_settings)
+		if (s.has_faults && HasFaults(s.faults))
+			g_sim->is_fault_enabled = true;
+}
+
+extern void SIM_WIFI_SetFaultSeed(uint32_t seed)
+{
+	for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+	{
+		auto& s = g_sim->server_settings[link_id];
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.fault_random_state = GetLinkSeed(seed, link_id);
+	}
+}
+
+extern void SIM_WIFI_SetFaults(const SIM_WIFI_Faults* faults)
+{
+	g_sim->faults = *faults;
+	UpdateFaultEnabled();
+}
+
+extern void SIM_WIFI_SetLinkFaults(size_t link_id, const SIM_WIFI_Faults* faults)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	auto& s = g_sim->server_settings[link_id];
+	s.has_faults = (faults != nullptr);
+	s.faults = (faults != nullptr) ? *faults : SIM_WIFI_Faults {};
+	UpdateFaultEnabled();
 }
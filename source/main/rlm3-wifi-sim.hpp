@@ -0,0 +1,70 @@
+#pragma once
+
+#include "rlm3-base.h"
+#include "rlm3-wifi.h"
+#include <memory>
+#include <functional>
+
+
+// Simulator internals shared between the wifi simulator translation units.  These run the named event
+// immediately and must be called from interrupt context.
+
+extern void SIM_WIFI_DeliverReceive(size_t link_id, const uint8_t* data, size_t size);
+extern void SIM_WIFI_DeliverConnect(size_t link_id);
+extern void SIM_WIFI_DeliverDisconnect(size_t link_id);
+
+// Scripted data referenced in place, like SIM_WIFI_TransmitRef and SIM_WIFI_ReceiveRef, but kept alive by the
+// owner until the simulator is done with it.  Receives go through the link model, coalescing and faults.
+extern void SIM_WIFI_TransmitShared(size_t link_id, const uint8_t* expected, size_t size, std::shared_ptr<const void> owner);
+extern void SIM_WIFI_ReceiveShared(size_t link_id, const uint8_t* data, size_t size, std::shared_ptr<const void> owner);
+
+// Queues an interrupt on the base simulator for the selected instance.  Unlike SIM_AddInterrupt it counts as
+// pending on the instance, so snapshots and SIM_WIFI_DestroyInstance know it is still queued.
+extern void SIM_WIFI_AddInterrupt(std::function<void()> interrupt);
+
+// Runs the callback from interrupt context at the given time.  Timers share the timed event heap instead of
+// waiting on the base simulator queue, so a long wait does not hold back link events that are due sooner.
+extern void SIM_WIFI_AddTimer(RLM3_Time time, std::function<void()> callback);
+
+// The driver API implementation.  RLM3_WIFI_* forward here unless RLM3_WIFI_SIM_AT is defined, in which case
+// the firmware links its real driver and only the emulated AT module calls these.
+extern bool SIM_WIFI_ModuleInit();
+extern void SIM_WIFI_ModuleDeinit();
+extern bool SIM_WIFI_ModuleIsInit();
+extern bool SIM_WIFI_ModuleGetVersion(uint32_t* at_version, uint32_t* sdk_version);
+extern bool SIM_WIFI_ModuleNetworkConnect(const char* ssid, const char* password);
+extern void SIM_WIFI_ModuleNetworkDisconnect();
+extern bool SIM_WIFI_ModuleIsNetworkConnected();
+extern bool SIM_WIFI_ModuleServerConnect(size_t link_id, const char* server, const char* service);
+extern void SIM_WIFI_ModuleServerDisconnect(size_t link_id);
+extern bool SIM_WIFI_ModuleIsServerConnected(size_t link_id);
+extern bool SIM_WIFI_ModuleLocalNetworkEnable(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service);
+extern void SIM_WIFI_ModuleLocalNetworkDisable();
+extern bool SIM_WIFI_ModuleIsLocalNetworkEnabled();
+extern bool SIM_WIFI_ModuleTransmit(size_t link_id, const uint8_t* data, size_t size);
+extern bool SIM_WIFI_ModuleTransmit2(size_t link_id, const uint8_t* data_a, size_t size_a, const uint8_t* data_b, size_t size_b);
+extern bool SIM_WIFI_ModuleTransmitV(size_t link_id, const RLM3_WIFI_Segment* segments, size_t segment_count);
+extern RLM3_WIFI_TransmitStatus SIM_WIFI_ModuleTransmitAsync(size_t link_id, const uint8_t* data, size_t size);
+extern void SIM_WIFI_ModuleSetReceiveRing(size_t link_id, uint8_t* buffer, size_t size);
+extern size_t SIM_WIFI_ModuleReceiveAcquire(size_t link_id, const uint8_t** data);
+extern void SIM_WIFI_ModuleReceiveRelease(size_t link_id, size_t size);
+
+// Link events are reported to the emulated AT module instead of the driver callbacks while it is active.
+extern bool SIM_WIFI_AT_IsActive();
+extern void SIM_WIFI_AT_NotifyReceive(size_t link_id, const uint8_t* data, size_t size);
+extern void SIM_WIFI_AT_NotifyConnect(size_t link_id);
+extern void SIM_WIFI_AT_NotifyDisconnect(size_t link_id);
+
+
+// Verification level, chosen at compile time.  2 checks driver state and transmitted data, 1 skips the
+// state checks, and 0 also skips comparing transmitted data against expectations.  Lower levels are meant
+// for performance runs where the firmware is known to drive the driver correctly.
+#ifndef RLM3_WIFI_SIM_VERIFY
+#define RLM3_WIFI_SIM_VERIFY 2
+#endif
+
+#if RLM3_WIFI_SIM_VERIFY >= 2
+#define SIM_WIFI_VERIFY(x) ASSERT(x)
+#else
+#define SIM_WIFI_VERIFY(x) ((void)sizeof(x))
+#endif
@@ -8,7 +8,105 @@ extern "C" {
 #endif
 
 
+#ifndef RLM3_WIFI_LINK_COUNT
 #define RLM3_WIFI_LINK_COUNT (5)
+#endif
+
+
+typedef struct RLM3_WIFI_Segment
+{
+	const uint8_t* data;
+	size_t size;
+} RLM3_WIFI_Segment;
+
+typedef enum RLM3_WIFI_TransmitStatus
+{
+	RLM3_WIFI_TRANSMIT_OK,
+	RLM3_WIFI_TRANSMIT_BUSY,
+	RLM3_WIFI_TRANSMIT_FAILED,
+} RLM3_WIFI_TransmitStatus;
+
+typedef struct SIM_WIFI_Stats
+{
+	size_t transmit_calls;
+	size_t transmit_bytes;
+	size_t transmit2_calls;
+	size_t transmit2_bytes;
+	size_t transmitv_calls;
+	size_t transmitv_bytes;
+	size_t transmit_async_calls;
+	size_t transmit_async_bytes;
+	size_t transmit_busy_count;
+	size_t transmit_in_flight_high_water;
+	size_t receive_bytes;
+	size_t receive_callbacks;
+	size_t connect_count;
+	size_t disconnect_count;
+	size_t transmit_pending_high_water;
+	size_t pending_interrupt_high_water;
+	size_t fault_count;
+	size_t receive_ring_high_water;
+	size_t receive_overrun_bytes;
+	RLM3_Time last_transmit_time;
+	RLM3_Time last_receive_time;
+	RLM3_Time last_connect_time;
+	RLM3_Time last_disconnect_time;
+} SIM_WIFI_Stats;
+
+// Fault probabilities range from 0 to 1.  Transmit rejects are rolled per transmit call and fragmentation per
+// receive payload.  Disconnects and network drops are rolled after each transmit and delivered receive.
+typedef struct SIM_WIFI_Faults
+{
+	double transmit_reject;
+	double receive_fragment;
+	double disconnect;
+	double network_drop;
+} SIM_WIFI_Faults;
+
+// Receive coalescing merges arriving data per link like a UART DMA ring.  Data is delivered in bursts of
+// burst_size bytes, after idle_timeout with no new data, or once the oldest pending byte has waited
+// max_latency.  Zero disables a trigger.
+typedef struct SIM_WIFI_Coalesce
+{
+	size_t burst_size;
+	RLM3_Time idle_timeout;
+	RLM3_Time max_latency;
+} SIM_WIFI_Coalesce;
+
+// A simulated device.  Each calling thread selects the instance the RLM3_WIFI and SIM_WIFI calls act on,
+// and callbacks run with the instance that raised them selected.
+typedef struct WifiSim SIM_WIFI_Instance;
+
+// Client churn connects client_count local-network clients, one attempt per connect_interval, while
+// respecting max_clients.  Each client sends receive_size bytes after connecting and leaves after about
+// session_time.  Intervals vary by up to half their value.
+typedef struct SIM_WIFI_Churn
+{
+	size_t client_count;
+	RLM3_Time connect_interval;
+	RLM3_Time session_time;
+	size_t receive_size;
+} SIM_WIFI_Churn;
+
+// Response times run from a client's connect to the firmware's first transmit on that link.  Callback
+// times are host time spent in the connect and disconnect callbacks.  Per-link sessions and responses
+// show how evenly the firmware serves its links.
+typedef struct SIM_WIFI_ChurnStats
+{
+	size_t sessions;
+	size_t deferred_connects;
+	size_t peak_clients;
+	size_t responses;
+	RLM3_Time response_total;
+	RLM3_Time response_max;
+	uint64_t callback_ns;
+	uint64_t callback_max_ns;
+	size_t link_sessions[RLM3_WIFI_LINK_COUNT];
+	size_t link_responses[RLM3_WIFI_LINK_COUNT];
+} SIM_WIFI_ChurnStats;
+
+// Fills buffer with up to size bytes of a lazily generated receive stream and returns the count, or 0 at the end.
+typedef size_t (*SIM_WIFI_ReceiveSource)(void* context, uint8_t* buffer, size_t size);
 
 
 extern bool RLM3_WIFI_Init();
@@ -29,22 +127,95 @@ extern bool RLM3_WIFI_LocalNetworkEnable(const char* ssid, const char* password,
 extern void RLM3_WIFI_LocalNetworkDisable();
 extern bool RLM3_WIFI_IsLocalNetworkEnabled();
 
+// Links may be driven from separate host threads, but only by calls that never queue work on the base
+// simulator, whose queue is not thread-safe against the test thread running it.  Those are blocking
+// transmits on a link with nothing in flight and the receive ring calls.  Everything else stays on the test
+// thread: the SIM_WIFI scripting calls (Transmit*, Receive*, Connect, Disconnect, the *At calls, churn,
+// replay, scenarios and snapshots), RLM3_WIFI_TransmitAsync, any transmit while faults are enabled, a
+// blocking transmit queued behind in-flight sends, and connects or network enables that start a bridge.
 extern bool RLM3_WIFI_Transmit(size_t link_id, const uint8_t* data, size_t size);
 extern bool RLM3_WIFI_Transmit2(size_t link_id, const uint8_t* data_a, size_t size_a, const uint8_t* data_b, size_t size_b);
+extern bool RLM3_WIFI_TransmitV(size_t link_id, const RLM3_WIFI_Segment* segments, size_t segment_count);
+extern RLM3_WIFI_TransmitStatus RLM3_WIFI_TransmitAsync(size_t link_id, const uint8_t* data, size_t size);
+extern void RLM3_WIFI_SetReceiveRing(size_t link_id, uint8_t* buffer, size_t size);
+extern size_t RLM3_WIFI_ReceiveAcquire(size_t link_id, const uint8_t** data);
+extern void RLM3_WIFI_ReceiveRelease(size_t link_id, size_t size);
 extern void RLM3_WIFI_Receive_Callback(size_t link_id, uint8_t data);
+extern void RLM3_WIFI_ReceiveBlock_Callback(size_t link_id, const uint8_t* data, size_t size);
 extern void RLM3_WIFI_NetworkConnect_Callback(size_t link_id, bool local_connection);
 extern void RLM3_WIFI_NetworkDisconnect_Callback(size_t link_id, bool local_connection);
+extern void RLM3_WIFI_TransmitComplete_Callback(size_t link_id);
+extern void RLM3_WIFI_ReceiveReady_Callback(size_t link_id);
 
 
+extern SIM_WIFI_Instance* SIM_WIFI_CreateInstance();
+extern void SIM_WIFI_DestroyInstance(SIM_WIFI_Instance* instance);
+extern void SIM_WIFI_SelectInstance(SIM_WIFI_Instance* instance);
+extern SIM_WIFI_Instance* SIM_WIFI_GetInstance();
+
+// A snapshot is a detached instance copied from the selected one.  It can be restored into any instance
+// whose queue is idle, with scheduled events moved by the time elapsed, and is freed with
+// SIM_WIFI_DestroyInstance.  Scripted calls still queued in the base simulator cannot be captured.
+extern SIM_WIFI_Instance* SIM_WIFI_Snapshot();
+extern void SIM_WIFI_Restore(const SIM_WIFI_Instance* snapshot);
+
 extern void SIM_WIFI_InitFailure();
 extern void SIM_WIFI_SetVersion(uint32_t at_version, uint32_t sdk_version);
 extern void SIM_WIFI_SetNetwork(const char* ssid, const char* password);
 extern void SIM_WIFI_SetLocalNetwork(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service);
 extern void SIM_WIFI_SetServer(size_t link_id, const char* server, const char* service);
+extern void SIM_WIFI_SetServerBridge(size_t link_id, const char* server, const char* service, uint16_t port);
+extern void SIM_WIFI_SetLocalNetworkBridge(const char* ssid, const char* password, size_t max_clients, const char* ip_address, const char* service, uint16_t port);
+extern void SIM_WIFI_SetLinkModel(size_t link_id, uint32_t bytes_per_second, RLM3_Time latency, RLM3_Time jitter, size_t send_buffer_size);
 extern void SIM_WIFI_Transmit(size_t link_id, const char* expected);
+extern void SIM_WIFI_TransmitBytes(size_t link_id, const uint8_t* expected, size_t size);
+extern void SIM_WIFI_TransmitRef(size_t link_id, const uint8_t* expected, size_t size);
+extern void SIM_WIFI_TransmitCrc32(size_t link_id, size_t size, uint32_t crc);
 extern void SIM_WIFI_Receive(size_t link_id, const char* data);
+extern void SIM_WIFI_ReceiveBytes(size_t link_id, const uint8_t* data, size_t size);
+extern void SIM_WIFI_ReceiveRef(size_t link_id, const uint8_t* data, size_t size);
+extern void SIM_WIFI_ReceiveStream(size_t link_id, SIM_WIFI_ReceiveSource source, void* context);
+extern bool SIM_WIFI_ReceiveFile(size_t link_id, const char* path);
+extern void SIM_WIFI_SetReceiveChunkSize(size_t chunk_size);
+extern void SIM_WIFI_SetTransmitWindow(size_t link_id, size_t buffers);
+extern void SIM_WIFI_SetCoalescing(size_t link_id, const SIM_WIFI_Coalesce* coalesce);
 extern void SIM_WIFI_Connect(size_t link_id);
 extern void SIM_WIFI_Disconnect(size_t link_id);
+extern void SIM_WIFI_ReceiveAt(size_t link_id, RLM3_Time time, const char* data);
+extern void SIM_WIFI_ReceiveBytesAt(size_t link_id, RLM3_Time time, const uint8_t* data, size_t size);
+extern void SIM_WIFI_ConnectAt(size_t link_id, RLM3_Time time);
+extern void SIM_WIFI_DisconnectAt(size_t link_id, RLM3_Time time);
+
+extern void SIM_WIFI_StartChurn(const SIM_WIFI_Churn* churn);
+extern bool SIM_WIFI_IsChurnActive();
+extern void SIM_WIFI_GetChurnStats(SIM_WIFI_ChurnStats* stats);
+
+extern void SIM_WIFI_GetStats(size_t link_id, SIM_WIFI_Stats* stats);
+extern void SIM_WIFI_ResetStats();
+
+extern void SIM_WIFI_SetFaultSeed(uint32_t seed);
+extern void SIM_WIFI_SetFaults(const SIM_WIFI_Faults* faults);
+extern void SIM_WIFI_SetLinkFaults(size_t link_id, const SIM_WIFI_Faults* faults);
+
+extern bool SIM_WIFI_StartCapture(const char* path);
+extern void SIM_WIFI_StopCapture();
+extern bool SIM_WIFI_ConvertCaptureToPcap(const char* capture_path, const char* pcap_path);
+
+extern bool SIM_WIFI_StartReplay(const char* path, bool original_timing);
+extern void SIM_WIFI_StopReplay();
+extern bool SIM_WIFI_IsReplayActive();
+
+extern bool SIM_WIFI_CompileScenario(const char* text_path, const char* binary_path);
+extern bool SIM_WIFI_StartScenario(const char* path);
+extern void SIM_WIFI_StopScenario();
+extern bool SIM_WIFI_IsScenarioActive();
+
+extern uint32_t SIM_WIFI_Crc32(uint32_t crc, const uint8_t* data, size_t size);
+
+extern void SIM_WIFI_AT_Start();
+extern void SIM_WIFI_AT_Stop();
+extern void SIM_WIFI_AT_Transmit(const uint8_t* data, size_t size);
+extern void SIM_WIFI_AT_Receive_Callback(const uint8_t* data, size_t size);
 
 
 #ifdef __cplusplus
@@ -1,12 +1,24 @@
 #include "Test.hpp"
 #include "rlm3-wifi.h"
 #include "rlm3-task.h"
+#include "rlm3-wifi-sim-capture.hpp"
 #include <cstring>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
 
 
 struct LinkRecvInfo
 {
 	volatile size_t count;
+	volatile size_t blocks;
 	char buffer[32];
 };
 static LinkRecvInfo g_link_recv_info[RLM3_WIFI_LINK_COUNT];
@@ -15,6 +27,9 @@ static bool g_network_connect_called = false;
 static bool g_network_disconnect_called = false;
 static size_t g_network_connect_link_id = 0;
 static size_t g_network_disconnect_link_id = 0;
+static SIM_WIFI_Instance* g_network_connect_instance = nullptr;
+static size_t g_transmit_complete_count = 0;
+static size_t g_receive_ready_count = 0;
 
 
 extern void RLM3_WIFI_Receive_Callback(size_t link_id, uint8_t data)
@@ -28,10 +43,20 @@ extern void RLM3_WIFI_Receive_Callback(size_t link_id, uint8_t data)
 	RLM3_GiveFromISR(g_task);
 }
 
+extern void RLM3_WIFI_ReceiveBlock_Callback(size_t link_id, const uint8_t* data, size_t size)
+{
+	ASSERT(link_id < RLM3_WIFI_LINK_COUNT);
+	ASSERT(size > 0);
+	g_link_recv_info[link_id].blocks++;
+	for (size_t i = 0; i < size; i++)
+		RLM3_WIFI_Receive_Callback(link_id, data[i]);
+}
+
 extern void RLM3_WIFI_NetworkConnect_Callback(size_t link_id, bool local_connection)
 {
 	g_network_connect_called = true;
 	g_network_connect_link_id = link_id;
+	g_network_connect_instance = SIM_WIFI_GetInstance();
 	RLM3_GiveFromISR(g_task);
 }
 
@@ -42,6 +67,68 @@ extern void RLM3_WIFI_NetworkDisconnect_Callback(size_t link_id, bool local_conn
 	RLM3_GiveFromISR(g_task);
 }
 
+extern void RLM3_WIFI_TransmitComplete_Callback(size_t link_id)
+{
+	g_transmit_complete_count++;
+	RLM3_GiveFromISR(g_task);
+}
+
+extern void RLM3_WIFI_ReceiveReady_Callback(size_t link_id)
+{
+	g_receive_ready_count++;
+	RLM3_GiveFromISR(g_task);
+}
+
+static std::string g_at_received;
+
+extern void SIM_WIFI_AT_Receive_Callback(const uint8_t* data, size_t size)
+{
+	g_at_received.append((const char*)data, size);
+	RLM3_GiveFromISR(g_task);
+}
+
+static void SendAT(const char* text)
+{
+	SIM_WIFI_AT_Transmit((const uint8_t*)text, std::strlen(text));
+}
+
+static void ExpectAT(const char* expected)
+{
+	// Waits for the module to send the expected text and consumes everything up to the end of it.
+	size_t position;
+	while ((position = g_at_received.find(expected)) == std::string::npos)
+		RLM3_Take();
+	g_at_received.erase(0, position + std::strlen(expected));
+}
+
+
+static int OpenTestListener(uint16_t* port)
+{
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT(fd >= 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ASSERT(::bind(fd, (const sockaddr*)&address, sizeof(address)) == 0);
+	ASSERT(::listen(fd, 4) == 0);
+	socklen_t length = sizeof(address);
+	ASSERT(::getsockname(fd, (sockaddr*)&address, &length) == 0);
+	*port = ntohs(address.sin_port);
+	return fd;
+}
+
+static int OpenTestConnection(uint16_t port)
+{
+	int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	ASSERT(fd >= 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ASSERT(::connect(fd, (const sockaddr*)&address, sizeof(address)) == 0);
+	return fd;
+}
+
 
 TEST_CASE(RLM3_WIFI_Init_HappyCase)
 {
@@ -307,6 +394,54 @@ TEST_CASE(RLM3_WIFI_Transmit2_HappyCase)
 	ASSERT(RLM3_WIFI_Transmit2(0, (const uint8_t*)"abcd", 4, (const uint8_t*)"efg", 3));
 }
 
+TEST_CASE(RLM3_WIFI_TransmitV_HappyCase)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "head-body-crc");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_WIFI_Segment segments[] = { { (const uint8_t*)"head-", 5 }, { (const uint8_t*)"body-", 5 }, { (const uint8_t*)"crc", 3 } };
+	ASSERT(RLM3_WIFI_TransmitV(0, segments, 3));
+}
+
+TEST_CASE(RLM3_WIFI_TransmitV_DataMismatch)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "head-body-crc");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_WIFI_Segment segments[] = { { (const uint8_t*)"head-", 5 }, { (const uint8_t*)"body-", 5 }, { (const uint8_t*)"crx", 3 } };
+	ASSERT_ASSERTS(RLM3_WIFI_TransmitV(0, segments, 3));
+}
+
+TEST_CASE(RLM3_WIFI_TransmitV_InvalidSize)
+{
+	static uint8_t buffer[600] = {};
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_TransmitRef(0, buffer, sizeof(buffer));
+	SIM_WIFI_TransmitRef(0, buffer, sizeof(buffer));
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_WIFI_Segment empty[] = { { buffer, 4 }, { buffer, 0 } };
+	ASSERT_ASSERTS(RLM3_WIFI_TransmitV(0, empty, 2));
+	ASSERT_ASSERTS(RLM3_WIFI_TransmitV(0, empty, 0));
+	RLM3_WIFI_Segment too_big[] = { { buffer, 600 }, { buffer, 425 } };
+	ASSERT_ASSERTS(RLM3_WIFI_TransmitV(0, too_big, 2));
+}
+
 TEST_CASE(RLM3_WIFI_Transmit_NotSet)
 {
 	SIM_WIFI_SetNetwork("test-ssid", "test-password");
@@ -381,6 +516,131 @@ TEST_CASE(RLM3_WIFI_Transmit_InvalidSizeTooBig)
 	ASSERT_ASSERTS(RLM3_WIFI_Transmit(0, buffer, 1025));
 }
 
+TEST_CASE(RLM3_WIFI_Transmit_SplitAcrossCalls)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "abc");
+	SIM_WIFI_Transmit(0, "defgh");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"ab", 2));
+	ASSERT(RLM3_WIFI_Transmit2(0, (const uint8_t*)"cde", 3, (const uint8_t*)"f", 1));
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"gh", 2));
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"i", 1));
+}
+
+TEST_CASE(RLM3_WIFI_Transmit_LargeBlock)
+{
+	char buffer[1025] = {};
+	for (size_t i = 0; i < 1024; i++)
+		buffer[i] = 'a' + (i % 26);
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, buffer);
+	SIM_WIFI_Transmit(0, buffer);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)buffer, 1024));
+	buffer[1000] = 'X';
+	ASSERT_ASSERTS(RLM3_WIFI_Transmit(0, (const uint8_t*)buffer, 1024));
+}
+
+TEST_CASE(RLM3_WIFI_Transmit_Binary)
+{
+	static const uint8_t expected[] = { 0x00, 0x01, 0x00, 0xFF };
+	static const uint8_t reference[] = { 0x10, 0x00, 0x20 };
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_TransmitBytes(0, expected, sizeof(expected));
+	SIM_WIFI_TransmitRef(0, reference, sizeof(reference));
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	static const uint8_t actual[] = { 0x00, 0x01, 0x00, 0xFF, 0x10, 0x00, 0x20 };
+	ASSERT(RLM3_WIFI_Transmit(0, actual, sizeof(actual)));
+	ASSERT(!RLM3_WIFI_Transmit(0, actual, 1));
+}
+
+TEST_CASE(RLM3_WIFI_Transmit_BinaryMismatch)
+{
+	static const uint8_t expected[] = { 0x00, 0x01, 0x00, 0xFF };
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_TransmitRef(0, expected, sizeof(expected));
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	static const uint8_t actual[] = { 0x00, 0x01, 0x01, 0xFF };
+	ASSERT_ASSERTS(RLM3_WIFI_Transmit(0, actual, sizeof(actual)));
+}
+
+TEST_CASE(RLM3_WIFI_Crc32_KnownValue)
+{
+	ASSERT(SIM_WIFI_Crc32(0, (const uint8_t*)"123456789", 9) == 0xCBF43926);
+	ASSERT(SIM_WIFI_Crc32(SIM_WIFI_Crc32(0, (const uint8_t*)"1234", 4), (const uint8_t*)"56789", 5) == 0xCBF43926);
+}
+
+TEST_CASE(RLM3_WIFI_TransmitCrc32_HappyCase)
+{
+	static uint8_t buffer[1024];
+	for (size_t i = 0; i < sizeof(buffer); i++)
+		buffer[i] = (uint8_t)(i * 7);
+	uint32_t crc = 0;
+	for (size_t i = 0; i < 1000; i++)
+		crc = SIM_WIFI_Crc32(crc, buffer, sizeof(buffer));
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "abc");
+	SIM_WIFI_TransmitCrc32(0, 1000 * sizeof(buffer), crc);
+	SIM_WIFI_Transmit(0, "xyz");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	// The stream may straddle the neighbouring byte expectations.
+	ASSERT(RLM3_WIFI_Transmit2(0, (const uint8_t*)"abc", 3, buffer, 100));
+	ASSERT(RLM3_WIFI_Transmit(0, buffer + 100, sizeof(buffer) - 100));
+	for (size_t i = 1; i < 999; i++)
+		ASSERT(RLM3_WIFI_Transmit(0, buffer, sizeof(buffer)));
+	ASSERT(RLM3_WIFI_Transmit(0, buffer, sizeof(buffer) - 3));
+	ASSERT(RLM3_WIFI_Transmit2(0, buffer + sizeof(buffer) - 3, 3, (const uint8_t*)"xyz", 3));
+	ASSERT(!RLM3_WIFI_Transmit(0, buffer, 1));
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.transmit_pending_high_water == 1000 * sizeof(buffer) + 6);
+}
+
+TEST_CASE(RLM3_WIFI_TransmitCrc32_Mismatch)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_TransmitCrc32(0, 6, SIM_WIFI_Crc32(0, (const uint8_t*)"abcdef", 6));
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"abc", 3));
+	ASSERT_ASSERTS(RLM3_WIFI_Transmit(0, (const uint8_t*)"deX", 3));
+}
+
 TEST_CASE(RLM3_WIFI_Receive_HappyCase)
 {
 	SIM_WIFI_SetNetwork("test-ssid", "test-password");
@@ -404,6 +664,134 @@ TEST_CASE(RLM3_WIFI_Receive_HappyCase)
 	ASSERT(std::strncmp(link_recv_info.buffer, "abcdef", 6) == 0);
 }
 
+TEST_CASE(RLM3_WIFI_Receive_Block)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Receive(0, "abcdefg");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	auto& link_recv_info = g_link_recv_info[0];
+	while (link_recv_info.count == 0)
+		RLM3_Take();
+	ASSERT(link_recv_info.count == 7);
+	ASSERT(link_recv_info.blocks == 1);
+	ASSERT(std::strncmp(link_recv_info.buffer, "abcdefg", 7) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Receive_ChunkSize)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetReceiveChunkSize(3);
+	SIM_WIFI_Receive(0, "abcdefg");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	auto& link_recv_info = g_link_recv_info[0];
+	while (link_recv_info.count == 0)
+		RLM3_Take();
+	ASSERT(link_recv_info.count == 3);
+	while (link_recv_info.count == 3)
+		RLM3_Take();
+	ASSERT(link_recv_info.count == 6);
+	while (link_recv_info.count == 6)
+		RLM3_Take();
+	ASSERT(link_recv_info.count == 7);
+	ASSERT(link_recv_info.blocks == 3);
+	ASSERT(std::strncmp(link_recv_info.buffer, "abcdefg", 7) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Receive_Binary)
+{
+	static const uint8_t reference[] = { 'd', 0x00, 'f' };
+	uint8_t data[] = { 'a', 0x00, 'c' };
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_ReceiveBytes(0, data, sizeof(data));
+	SIM_WIFI_ReceiveRef(0, reference, sizeof(reference));
+	data[0] = 'x';
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	auto& link_recv_info = g_link_recv_info[0];
+	while (link_recv_info.count < 6)
+		RLM3_Take();
+	ASSERT(link_recv_info.count == 6);
+	ASSERT(link_recv_info.blocks == 2);
+	ASSERT(std::memcmp(link_recv_info.buffer, "a\0cd\0f", 6) == 0);
+}
+
+struct TestReceiveSource
+{
+	size_t remaining;
+	size_t position;
+	size_t calls;
+};
+
+static size_t GenerateTestReceive(void* context, uint8_t* buffer, size_t size)
+{
+	auto& source = *(TestReceiveSource*)context;
+	size_t count = std::min(size, source.remaining);
+	for (size_t i = 0; i < count; i++)
+		buffer[i] = 'a' + (source.position++ % 26);
+	source.remaining -= count;
+	source.calls++;
+	return count;
+}
+
+TEST_CASE(RLM3_WIFI_ReceiveStream_HappyCase)
+{
+	TestReceiveSource source = { 1000000, 0, 0 };
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_ReceiveStream(0, GenerateTestReceive, &source);
+	ASSERT(source.calls == 1);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 1000000)
+		RLM3_Take();
+
+	ASSERT(g_link_recv_info[0].count == 1000000);
+	ASSERT(g_link_recv_info[0].blocks == (1000000 + 1023) / 1024);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcdefghijklmnopqrstuvwxyzabcdef", 32) == 0);
+	ASSERT(source.remaining == 0);
+}
+
+TEST_CASE(RLM3_WIFI_ReceiveFile_HappyCase)
+{
+	char path[] = "/tmp/rlm3-wifi-receive-XXXXXX";
+	int fd = ::mkstemp(path);
+	ASSERT(::write(fd, "hello stream", 12) == 12);
+	::close(fd);
+
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetReceiveChunkSize(5);
+	ASSERT(SIM_WIFI_ReceiveFile(0, path));
+	ASSERT(!SIM_WIFI_ReceiveFile(0, "/tmp/rlm3-wifi-missing-file"));
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 12)
+		RLM3_Take();
+
+	ASSERT(g_link_recv_info[0].blocks == 3);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "hello stream", 12) == 0);
+	std::remove(path);
+}
+
 TEST_CASE(RLM3_WIFI_ReceiveMultiple_HappyCase)
 {
 	SIM_WIFI_SetNetwork("test-ssid", "test-password");
@@ -432,39 +820,1218 @@ TEST_CASE(RLM3_WIFI_ReceiveMultiple_HappyCase)
 	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcdef", 6) == 0);
 }
 
-TEST_CASE(RLM3_WIFI_LocalNetwork_HappyCase)
+TEST_CASE(RLM3_WIFI_Coalesce_BurstSize)
 {
-	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
-	SIM_WIFI_Connect(0);
-	SIM_WIFI_Receive(0, "abc");
-	SIM_WIFI_Connect(1);
-	SIM_WIFI_Transmit(1, "hello world");
-	SIM_WIFI_Disconnect(1);
-	SIM_WIFI_Disconnect(0);
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Coalesce coalesce = { 4, 0, 0 };
+	SIM_WIFI_SetCoalescing(0, &coalesce);
+	SIM_WIFI_Receive(0, "ab");
+	SIM_WIFI_Receive(0, "cde");
+	SIM_WIFI_Receive(0, "fghij");
 
 	RLM3_WIFI_Init();
-	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
-	ASSERT(!g_network_connect_called);
-	RLM3_Take();
-	ASSERT(g_network_connect_called);
-	ASSERT(g_network_connect_link_id == 0);
-	g_network_connect_called = false;
-	ASSERT(g_link_recv_info[0].count == 0);
-	RLM3_Take();
-	ASSERT(g_link_recv_info[0].count == 3);
-	ASSERT(!g_network_connect_called);
-	RLM3_Take();
-	ASSERT(g_network_connect_called);
-	ASSERT(g_network_connect_link_id == 1);
-	RLM3_WIFI_Transmit(1, (const uint8_t*)"hello world", 11);
-	ASSERT(!g_network_disconnect_called);
-	RLM3_Take();
-	ASSERT(g_network_disconnect_called);
-	ASSERT(g_network_disconnect_link_id == 1);
-	g_network_disconnect_called = false;
-	RLM3_Take();
-	ASSERT(g_network_disconnect_called);
-	ASSERT(g_network_disconnect_link_id == 0);
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 8)
+		RLM3_Take();
+
+	ASSERT(g_link_recv_info[0].count == 8);
+	ASSERT(g_link_recv_info[0].blocks == 2);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcdefgh", 8) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Coalesce_IdleTimeout)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Coalesce coalesce = { 0, 10, 0 };
+	SIM_WIFI_SetCoalescing(0, &coalesce);
+	SIM_WIFI_Receive(0, "ab");
+	SIM_WIFI_Receive(0, "cd");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	RLM3_Time start = RLM3_GetCurrentTime();
+	while (g_link_recv_info[0].count < 4)
+		RLM3_Take();
+
+	ASSERT(RLM3_GetCurrentTime() - start == 10);
+	ASSERT(g_link_recv_info[0].blocks == 1);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcd", 4) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Coalesce_MaxLatency)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 1000, 0, 0, 0);
+	SIM_WIFI_Coalesce coalesce = { 0, 0, 4 };
+	SIM_WIFI_SetCoalescing(0, &coalesce);
+	for (size_t i = 0; i < 10; i++)
+		SIM_WIFI_Receive(0, "x");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 10)
+		RLM3_Take();
+
+	// Bytes arrive 1 ms apart; every fifth arrival flushes the four before it and the timer flushes the rest.
+	ASSERT(g_link_recv_info[0].blocks == 3);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_ReceiveDelay)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 1000, 100, 0, 0);
+	SIM_WIFI_Receive(0, "abcdefghij");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	while (g_link_recv_info[0].count == 0)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 110);
+	ASSERT(g_link_recv_info[0].count == 10);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_LatencyOverlaps)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 1000, 100, 0, 0);
+	SIM_WIFI_Receive(0, "abcdefghij");
+	SIM_WIFI_Receive(0, "klmnopqrst");
+	SIM_WIFI_Receive(0, "uvwxyz0123");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	while (g_link_recv_info[0].count < 10)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 110);
+	while (g_link_recv_info[0].count < 20)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 120);
+	while (g_link_recv_info[0].count < 30)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 130);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcdefghijklmnopqrstuvwxyz0123", 30) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_ReceiveStream)
+{
+	TestReceiveSource source = { 30, 0, 0 };
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 1000, 100, 0, 0);
+	SIM_WIFI_SetReceiveChunkSize(10);
+	SIM_WIFI_ReceiveStream(0, GenerateTestReceive, &source);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	while (g_link_recv_info[0].count < 10)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 110);
+	while (g_link_recv_info[0].count < 30)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 130);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_LinksIndependent)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetServer(1, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 1000, 0, 0);
+	SIM_WIFI_SetLinkModel(1, 0, 20, 0, 0);
+	SIM_WIFI_Receive(0, "slow");
+	SIM_WIFI_Receive(1, "fast");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	RLM3_WIFI_ServerConnect(1, "test-server", "test-service");
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	while (g_link_recv_info[1].count < 4)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 20);
+	ASSERT(g_link_recv_info[0].count == 0);
+	while (g_link_recv_info[0].count < 4)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 1000);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_DisconnectAfterReceive)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 100, 0, 0);
+	SIM_WIFI_Receive(0, "abc");
+	SIM_WIFI_Disconnect(0);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 100);
+	ASSERT(g_link_recv_info[0].count == 3);
+	ASSERT(std::memcmp(g_link_recv_info[0].buffer, "abc", 3) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_DisconnectAtAfterReceiveAt)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 100, 0, 0);
+	SIM_WIFI_ReceiveAt(0, 10, "abc");
+	SIM_WIFI_DisconnectAt(0, 20);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 110);
+	ASSERT(g_link_recv_info[0].count == 3);
+}
+
+TEST_CASE(RLM3_WIFI_LinkModel_SendBufferFull)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 1000, 0, 0, 8);
+	SIM_WIFI_Transmit(0, "abcdefghi");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"abcdefgh", 8));
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"i", 1));
+	RLM3_Delay(1);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"i", 1));
+}
+
+TEST_CASE(RLM3_WIFI_TransmitAsync_Window)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 10, 0, 0);
+	SIM_WIFI_SetTransmitWindow(0, 2);
+	SIM_WIFI_Transmit(0, "abcdef");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	ASSERT(RLM3_WIFI_TransmitAsync(0, (const uint8_t*)"ab", 2) == RLM3_WIFI_TRANSMIT_OK);
+	ASSERT(RLM3_WIFI_TransmitAsync(0, (const uint8_t*)"cd", 2) == RLM3_WIFI_TRANSMIT_OK);
+	ASSERT(RLM3_WIFI_TransmitAsync(0, (const uint8_t*)"ef", 2) == RLM3_WIFI_TRANSMIT_BUSY);
+	while (g_transmit_complete_count < 2)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 10);
+	ASSERT(RLM3_WIFI_TransmitAsync(0, (const uint8_t*)"ef", 2) == RLM3_WIFI_TRANSMIT_OK);
+	while (g_transmit_complete_count < 3)
+		RLM3_Take();
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.transmit_async_calls == 4);
+	ASSERT(stats.transmit_async_bytes == 6);
+	ASSERT(stats.transmit_busy_count == 1);
+	ASSERT(stats.transmit_in_flight_high_water == 2);
+}
+
+TEST_CASE(RLM3_WIFI_TransmitAsync_BufferReused)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 10, 0, 0);
+	SIM_WIFI_Transmit(0, "abcd");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	uint8_t buffer[4] = { 'a', 'b', 'c', 'd' };
+	ASSERT(RLM3_WIFI_TransmitAsync(0, buffer, 4) == RLM3_WIFI_TRANSMIT_OK);
+	buffer[0] = 'x';
+	ASSERT_ASSERTS(RLM3_Delay(20));
+}
+
+TEST_CASE(RLM3_WIFI_TransmitAsync_MixedOrder)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 10, 0, 0);
+	SIM_WIFI_Transmit(0, "abcd");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	uint8_t buffer[2] = { 'c', 'd' };
+	ASSERT(RLM3_WIFI_TransmitAsync(0, (const uint8_t*)"ab", 2) == RLM3_WIFI_TRANSMIT_OK);
+	ASSERT(RLM3_WIFI_Transmit(0, buffer, 2));
+	buffer[0] = 'x';
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"e", 1));
+	while (g_transmit_complete_count < 1)
+		RLM3_Take();
+	RLM3_Delay(10);
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.transmit_async_bytes == 2);
+	ASSERT(stats.transmit_bytes == 2);
+	ASSERT(g_transmit_complete_count == 1);
+}
+
+TEST_CASE(RLM3_WIFI_Instance_Fleet)
+{
+	SIM_WIFI_Instance* device = SIM_WIFI_CreateInstance();
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Receive(0, "abc");
+	SIM_WIFI_SelectInstance(device);
+	SIM_WIFI_SetNetwork("other-ssid", "other-password");
+	SIM_WIFI_SetServer(0, "other-server", "other-service");
+	SIM_WIFI_Transmit(0, "xyz");
+
+	ASSERT(RLM3_WIFI_Init());
+	ASSERT(RLM3_WIFI_NetworkConnect("other-ssid", "other-password"));
+	ASSERT(RLM3_WIFI_ServerConnect(0, "other-server", "other-service"));
+	ASSERT(g_network_connect_instance == device);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"xyz", 3));
+
+	SIM_WIFI_SelectInstance(nullptr);
+	ASSERT(!RLM3_WIFI_IsInit());
+	ASSERT(RLM3_WIFI_Init());
+	ASSERT(RLM3_WIFI_NetworkConnect("test-ssid", "test-password"));
+	ASSERT(RLM3_WIFI_ServerConnect(0, "test-server", "test-service"));
+	ASSERT(g_network_connect_instance != device);
+	while (g_link_recv_info[0].count < 3)
+		RLM3_Take();
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.receive_bytes == 3 && stats.transmit_bytes == 0);
+	SIM_WIFI_SelectInstance(device);
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.receive_bytes == 0 && stats.transmit_bytes == 3);
+	SIM_WIFI_DestroyInstance(device);
+	ASSERT(SIM_WIFI_GetInstance() != device);
+}
+
+TEST_CASE(RLM3_WIFI_Snapshot_Fork)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "hello");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"hello", 5));
+	SIM_WIFI_Transmit(0, "data");
+	SIM_WIFI_ReceiveAt(0, RLM3_GetCurrentTime() + 50, "pong");
+	SIM_WIFI_Instance* snapshot = SIM_WIFI_Snapshot();
+
+	for (size_t fork = 0; fork < 2; fork++)
+	{
+		SIM_WIFI_Restore(snapshot);
+		ASSERT(RLM3_WIFI_IsServerConnected(0));
+		g_link_recv_info[0].count = 0;
+		RLM3_Time start = RLM3_GetCurrentTime();
+		ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"data", 4));
+		while (g_link_recv_info[0].count < 4)
+			RLM3_Take();
+		ASSERT(RLM3_GetCurrentTime() - start == 50);
+		ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"more", 4));
+	}
+	SIM_WIFI_DestroyInstance(snapshot);
+}
+
+TEST_CASE(RLM3_WIFI_Snapshot_ReceiveRing)
+{
+	uint8_t ring[8];
+	RLM3_WIFI_SetReceiveRing(0, ring, sizeof(ring));
+	ASSERT_ASSERTS(SIM_WIFI_Snapshot());
+	RLM3_WIFI_SetReceiveRing(0, nullptr, 0);
+	SIM_WIFI_DestroyInstance(SIM_WIFI_Snapshot());
+}
+
+TEST_CASE(RLM3_WIFI_ReceiveRing_Wrap)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Receive(0, "abcdef");
+	SIM_WIFI_Receive(0, "ghij");
+
+	uint8_t ring[8];
+	RLM3_WIFI_SetReceiveRing(0, ring, sizeof(ring));
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_receive_ready_count < 1)
+		RLM3_Take();
+
+	const uint8_t* data = nullptr;
+	ASSERT(RLM3_WIFI_ReceiveAcquire(0, &data) == 6);
+	ASSERT(data == ring && std::memcmp(data, "abcdef", 6) == 0);
+	RLM3_WIFI_ReceiveRelease(0, 4);
+	while (g_receive_ready_count < 2)
+		RLM3_Take();
+	ASSERT(RLM3_WIFI_ReceiveAcquire(0, &data) == 4);
+	ASSERT(std::memcmp(data, "efgh", 4) == 0);
+	RLM3_WIFI_ReceiveRelease(0, 4);
+	ASSERT(RLM3_WIFI_ReceiveAcquire(0, &data) == 2);
+	ASSERT(data == ring && std::memcmp(data, "ij", 2) == 0);
+	RLM3_WIFI_ReceiveRelease(0, 2);
+	ASSERT(RLM3_WIFI_ReceiveAcquire(0, &data) == 0);
+	ASSERT(g_link_recv_info[0].count == 0);
+}
+
+TEST_CASE(RLM3_WIFI_ReceiveRing_Overrun)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Receive(0, "abcdefghij");
+
+	uint8_t ring[8];
+	RLM3_WIFI_SetReceiveRing(0, ring, sizeof(ring));
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_receive_ready_count < 1)
+		RLM3_Take();
+
+	const uint8_t* data = nullptr;
+	ASSERT(RLM3_WIFI_ReceiveAcquire(0, &data) == 8);
+	ASSERT_ASSERTS(RLM3_WIFI_ReceiveRelease(0, 9));
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.receive_ring_high_water == 8);
+	ASSERT(stats.receive_overrun_bytes == 2);
+}
+
+TEST_CASE(RLM3_WIFI_Bridge_Server)
+{
+	uint16_t port = 0;
+	int listener = OpenTestListener(&port);
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServerBridge(0, "test-server", "test-service", port);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	ASSERT(RLM3_WIFI_ServerConnect(0, "test-server", "test-service"));
+	int peer = ::accept(listener, nullptr, nullptr);
+	ASSERT(peer >= 0);
+
+	char buffer[8] = {};
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"hello", 5));
+	ASSERT(::recv(peer, buffer, 5, MSG_WAITALL) == 5);
+	ASSERT(std::strncmp(buffer, "hello", 5) == 0);
+
+	ASSERT(::send(peer, "world", 5, 0) == 5);
+	while (g_link_recv_info[0].count < 5)
+		RLM3_Take();
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "world", 5) == 0);
+
+	::close(peer);
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(g_network_disconnect_link_id == 0);
+	ASSERT(!RLM3_WIFI_IsServerConnected(0));
+	::close(listener);
+}
+
+TEST_CASE(RLM3_WIFI_Bridge_LocalNetwork)
+{
+	uint16_t port = 0;
+	::close(OpenTestListener(&port));
+	SIM_WIFI_SetLocalNetworkBridge("test-ssid", "test-password", 2, "test-ip-address", "test-service", port);
+
+	RLM3_WIFI_Init();
+	ASSERT(RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service"));
+	int client = OpenTestConnection(port);
+	while (!g_network_connect_called)
+		RLM3_Take();
+	ASSERT(g_network_connect_link_id == 0);
+	ASSERT(RLM3_WIFI_IsServerConnected(0));
+
+	ASSERT(::send(client, "abc", 3, 0) == 3);
+	while (g_link_recv_info[0].count < 3)
+		RLM3_Take();
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abc", 3) == 0);
+
+	char buffer[8] = {};
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"xyz", 3));
+	ASSERT(::recv(client, buffer, 3, MSG_WAITALL) == 3);
+	ASSERT(std::strncmp(buffer, "xyz", 3) == 0);
+	::close(client);
+}
+
+TEST_CASE(RLM3_WIFI_Capture_HappyCase)
+{
+	char capture_path[] = "/tmp/rlm3-wifi-capture-XXXXXX";
+	::close(::mkstemp(capture_path));
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "abcd");
+	SIM_WIFI_Receive(0, "xyz");
+
+	ASSERT(SIM_WIFI_StartCapture(capture_path));
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	ASSERT(RLM3_WIFI_Transmit2(0, (const uint8_t*)"ab", 2, (const uint8_t*)"cd", 2));
+	while (g_link_recv_info[0].count < 3)
+		RLM3_Take();
+	RLM3_WIFI_ServerDisconnect(0);
+	RLM3_WIFI_NetworkDisconnect();
+	SIM_WIFI_StopCapture();
+
+	std::FILE* file = std::fopen(capture_path, "rb");
+	ASSERT(file != nullptr);
+	ASSERT(SIM_WIFI_ReadCaptureFileHeader(file));
+	SIM_WIFI_CaptureType expected_types[] = { SIM_WIFI_CAPTURE_NETWORK_UP, SIM_WIFI_CAPTURE_CONNECT, SIM_WIFI_CAPTURE_TRANSMIT, SIM_WIFI_CAPTURE_RECEIVE, SIM_WIFI_CAPTURE_DISCONNECT, SIM_WIFI_CAPTURE_NETWORK_DOWN };
+	for (auto expected_type : expected_types)
+	{
+		SIM_WIFI_CaptureHeader header;
+		ASSERT(SIM_WIFI_ReadCaptureHeader(file, &header));
+		ASSERT(header.type == expected_type);
+		char data[8] = {};
+		ASSERT(header.size <= sizeof(data));
+		if (header.size > 0)
+			ASSERT(std::fread(data, header.size, 1, file) == 1);
+		if (expected_type == SIM_WIFI_CAPTURE_TRANSMIT)
+			ASSERT(header.size == 4 && std::strncmp(data, "abcd", 4) == 0);
+		if (expected_type == SIM_WIFI_CAPTURE_RECEIVE)
+			ASSERT(header.size == 3 && std::strncmp(data, "xyz", 3) == 0);
+	}
+	SIM_WIFI_CaptureHeader header;
+	ASSERT(!SIM_WIFI_ReadCaptureHeader(file, &header));
+	std::fclose(file);
+
+	char pcap_path[] = "/tmp/rlm3-wifi-pcap-XXXXXX";
+	::close(::mkstemp(pcap_path));
+	ASSERT(SIM_WIFI_ConvertCaptureToPcap(capture_path, pcap_path));
+	file = std::fopen(pcap_path, "rb");
+	ASSERT(file != nullptr);
+	std::fseek(file, 0, SEEK_END);
+	// Global header, SYN and SYN-ACK, two data packets and a FIN.
+	ASSERT(std::ftell(file) == 24 + 5 * (16 + 40) + 4 + 3);
+	std::fclose(file);
+	std::remove(capture_path);
+	std::remove(pcap_path);
+}
+
+static void WriteTestCaptureRecord(std::FILE* file, RLM3_Time time, SIM_WIFI_CaptureType type, uint8_t flags, uint16_t link_id, const char* data)
+{
+	uint32_t size = std::strlen(data);
+	uint8_t header[12] = { (uint8_t)time, (uint8_t)(time >> 8), (uint8_t)(time >> 16), (uint8_t)(time >> 24), type, flags, (uint8_t)link_id, (uint8_t)(link_id >> 8), (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24) };
+	std::fwrite(header, sizeof(header), 1, file);
+	std::fwrite(data, size, 1, file);
+}
+
+static void WriteTestReplay(const char* path)
+{
+	std::FILE* file = std::fopen(path, "wb");
+	ASSERT(file != nullptr);
+	std::fwrite(SIM_WIFI_CAPTURE_MAGIC "\x01\0\0\0", 12, 1, file);
+	uint8_t remote = SIM_WIFI_CAPTURE_FLAG_LOCAL | SIM_WIFI_CAPTURE_FLAG_REMOTE;
+	WriteTestCaptureRecord(file, 1000, SIM_WIFI_CAPTURE_NETWORK_UP, SIM_WIFI_CAPTURE_FLAG_LOCAL, 0, "");
+	WriteTestCaptureRecord(file, 1050, SIM_WIFI_CAPTURE_CONNECT, remote, 0, "");
+	WriteTestCaptureRecord(file, 1100, SIM_WIFI_CAPTURE_RECEIVE, remote, 0, "ping");
+	WriteTestCaptureRecord(file, 1110, SIM_WIFI_CAPTURE_TRANSMIT, SIM_WIFI_CAPTURE_FLAG_LOCAL, 0, "pong");
+	WriteTestCaptureRecord(file, 1200, SIM_WIFI_CAPTURE_DISCONNECT, remote, 0, "");
+	std::fclose(file);
+}
+
+static void RunTestReplay()
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	while (!g_network_connect_called)
+		RLM3_Take();
+	while (g_link_recv_info[0].count < 4)
+		RLM3_Take();
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "ping", 4) == 0);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(!SIM_WIFI_IsReplayActive());
+}
+
+static void WriteTestScenario(const char* path)
+{
+	std::FILE* file = std::fopen(path, "w");
+	ASSERT(file != nullptr);
+	std::fputs("# ping pong\n", file);
+	std::fputs("network test-ssid test-password\n", file);
+	std::fputs("server 0 test-server test-service\n", file);
+	std::fputs("wait 100\n", file);
+	std::fputs("receive 0 ping \\x01\\r\\n\n", file);
+	std::fputs("transmit 0 pong\n", file);
+	std::fputs("wait 50\n", file);
+	std::fputs("disconnect 0\n", file);
+	std::fclose(file);
+}
+
+static void RunTestScenario(const char* path)
+{
+	RLM3_Time start = RLM3_GetCurrentTime();
+	ASSERT(SIM_WIFI_StartScenario(path));
+	RLM3_WIFI_Init();
+	ASSERT(RLM3_WIFI_NetworkConnect("test-ssid", "test-password"));
+	ASSERT(RLM3_WIFI_ServerConnect(0, "test-server", "test-service"));
+	while (g_link_recv_info[0].count < 7)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 100);
+	ASSERT(std::memcmp(g_link_recv_info[0].buffer, "ping \x01\r\n", 7) == 0);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - start == 150);
+	ASSERT(!SIM_WIFI_IsScenarioActive());
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_Text)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestScenario(path);
+	RunTestScenario(path);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_Compiled)
+{
+	char text_path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	char binary_path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(text_path));
+	::close(::mkstemp(binary_path));
+	WriteTestScenario(text_path);
+	ASSERT(SIM_WIFI_CompileScenario(text_path, binary_path));
+	std::remove(text_path);
+	RunTestScenario(binary_path);
+	std::remove(binary_path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_Restart)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestScenario(path);
+	ASSERT(SIM_WIFI_StartScenario(path));
+	SIM_WIFI_StopScenario();
+	RunTestScenario(path);
+	RLM3_Delay(200);
+	ASSERT(g_link_recv_info[0].count == 8);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_RestartKeepsExpectations)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	std::FILE* file = std::fopen(path, "w");
+	std::fputs("network test-ssid test-password\nserver 0 test-server test-service\ntransmit 0 pong\n", file);
+	std::fclose(file);
+	ASSERT(SIM_WIFI_StartScenario(path));
+	ASSERT(SIM_WIFI_StartScenario(path));
+
+	RLM3_WIFI_Init();
+	ASSERT(RLM3_WIFI_NetworkConnect("test-ssid", "test-password"));
+	ASSERT(RLM3_WIFI_ServerConnect(0, "test-server", "test-service"));
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_LinkModel)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestScenario(path);
+	SIM_WIFI_SetLinkModel(0, 0, 20, 0, 0);
+
+	ASSERT(SIM_WIFI_StartScenario(path));
+	RLM3_WIFI_Init();
+	ASSERT(RLM3_WIFI_NetworkConnect("test-ssid", "test-password"));
+	ASSERT(RLM3_WIFI_ServerConnect(0, "test-server", "test-service"));
+	while (g_link_recv_info[0].count < 8)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 120);
+	ASSERT(std::memcmp(g_link_recv_info[0].buffer, "ping \x01\r\n", 8) == 0);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_Invalid)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	std::FILE* file = std::fopen(path, "w");
+	std::fputs("network test-ssid test-password\nreceive 99 data\n", file);
+	std::fclose(file);
+	ASSERT(!SIM_WIFI_StartScenario(path));
+	ASSERT(!SIM_WIFI_IsScenarioActive());
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_Snapshot)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	std::FILE* file = std::fopen(path, "w");
+	std::fputs("local-network test-ssid test-password 2 test-ip-address test-service\nconnect 0\n", file);
+	std::fclose(file);
+
+	// The queued connect is state the snapshot cannot capture.
+	ASSERT(SIM_WIFI_StartScenario(path));
+	ASSERT_ASSERTS(SIM_WIFI_Snapshot());
+	SIM_WIFI_StopScenario();
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Scenario_CompiledTruncated)
+{
+	char path[] = "/tmp/rlm3-wifi-scenario-XXXXXX";
+	::close(::mkstemp(path));
+	// The header claims far more events and data than the file holds.
+	static const uint8_t header[] = { 'R', 'L', 'M', '3', 'W', 'S', 'C', 'N', 1, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0 };
+	std::FILE* file = std::fopen(path, "wb");
+	std::fwrite(header, sizeof(header), 1, file);
+	std::fclose(file);
+	ASSERT(!SIM_WIFI_StartScenario(path));
+	ASSERT(!SIM_WIFI_IsScenarioActive());
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Replay_OriginalTiming)
+{
+	char path[] = "/tmp/rlm3-wifi-replay-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestReplay(path);
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	ASSERT(SIM_WIFI_StartReplay(path, true));
+	RunTestReplay();
+	ASSERT(RLM3_GetCurrentTime() - start == 150);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Replay_FastAsPossible)
+{
+	char path[] = "/tmp/rlm3-wifi-replay-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestReplay(path);
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	ASSERT(SIM_WIFI_StartReplay(path, false));
+	RunTestReplay();
+	ASSERT(RLM3_GetCurrentTime() == start);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Replay_Restart)
+{
+	char path[] = "/tmp/rlm3-wifi-replay-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestReplay(path);
+
+	RLM3_Time start = RLM3_GetCurrentTime();
+	ASSERT(SIM_WIFI_StartReplay(path, true));
+	SIM_WIFI_StopReplay();
+	ASSERT(SIM_WIFI_StartReplay(path, true));
+	RunTestReplay();
+	ASSERT(RLM3_GetCurrentTime() - start == 150);
+	ASSERT(g_link_recv_info[0].count == 4);
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_Replay_Snapshot)
+{
+	char path[] = "/tmp/rlm3-wifi-replay-XXXXXX";
+	::close(::mkstemp(path));
+	WriteTestReplay(path);
+
+	// The queued replay event is state the snapshot cannot capture.
+	ASSERT(SIM_WIFI_StartReplay(path, false));
+	ASSERT_ASSERTS(SIM_WIFI_Snapshot());
+	SIM_WIFI_StopReplay();
+	std::remove(path);
+}
+
+TEST_CASE(RLM3_WIFI_LinkCount_LastLink)
+{
+	const size_t link_id = RLM3_WIFI_LINK_COUNT - 1;
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(link_id, "test-server", "test-service");
+	SIM_WIFI_Transmit(link_id, "abc");
+	SIM_WIFI_Receive(link_id, "xyz");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	ASSERT(RLM3_WIFI_ServerConnect(link_id, "test-server", "test-service"));
+	ASSERT(RLM3_WIFI_Transmit(link_id, (const uint8_t*)"abc", 3));
+	while (g_link_recv_info[link_id].count < 3)
+		RLM3_Take();
+	ASSERT(std::strncmp(g_link_recv_info[link_id].buffer, "xyz", 3) == 0);
+	ASSERT_ASSERTS(SIM_WIFI_SetServer(RLM3_WIFI_LINK_COUNT, "test-server", "test-service"));
+}
+
+TEST_CASE(RLM3_WIFI_Timed_LocalNetwork)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	SIM_WIFI_DisconnectAt(0, 50);
+	SIM_WIFI_ReceiveAt(0, 30, "abc");
+	SIM_WIFI_ConnectAt(0, 10);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	while (!g_network_connect_called)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 10);
+	while (g_link_recv_info[0].count < 3)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 30);
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 50);
+}
+
+TEST_CASE(RLM3_WIFI_Timed_EarlierAfterLater)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_ReceiveAt(0, 100000, "late");
+	SIM_WIFI_ReceiveAt(0, 5, "go");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 2)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 5);
+	SIM_WIFI_ReceiveAt(0, RLM3_GetCurrentTime() + 10, "early");
+	while (g_link_recv_info[0].count < 7)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 15);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer + 2, "early", 5) == 0);
+	while (g_link_recv_info[0].count < 11)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() == 100000);
+}
+
+TEST_CASE(RLM3_WIFI_Timed_ResponseLatency)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_ReceiveAt(0, 100, "ping");
+	SIM_WIFI_Transmit(0, "pong");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	while (g_link_recv_info[0].count < 4)
+		RLM3_Take();
+	RLM3_Delay(7);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"pong", 4));
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.last_receive_time == 100);
+	ASSERT(stats.last_transmit_time - stats.last_receive_time == 7);
+}
+
+TEST_CASE(RLM3_WIFI_Stats_HappyCase)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "abcdefghij");
+	SIM_WIFI_SetReceiveChunkSize(2);
+	SIM_WIFI_Receive(0, "xyz");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"abc", 3));
+	ASSERT(RLM3_WIFI_Transmit2(0, (const uint8_t*)"de", 2, (const uint8_t*)"fg", 2));
+	RLM3_WIFI_Segment segments[] = { { (const uint8_t*)"hi", 2 }, { (const uint8_t*)"j", 1 } };
+	ASSERT(RLM3_WIFI_TransmitV(0, segments, 2));
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"k", 1));
+	while (g_link_recv_info[0].count < 3)
+		RLM3_Take();
+	RLM3_WIFI_ServerDisconnect(0);
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.transmit_calls == 2);
+	ASSERT(stats.transmit_bytes == 3);
+	ASSERT(stats.transmit2_calls == 1);
+	ASSERT(stats.transmit2_bytes == 4);
+	ASSERT(stats.transmitv_calls == 1);
+	ASSERT(stats.transmitv_bytes == 3);
+	ASSERT(stats.receive_bytes == 3);
+	ASSERT(stats.receive_callbacks == 2);
+	ASSERT(stats.connect_count == 1);
+	ASSERT(stats.disconnect_count == 1);
+	ASSERT(stats.transmit_pending_high_water == 10);
+	ASSERT(stats.pending_interrupt_high_water == 2);
+
+	SIM_WIFI_ResetStats();
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.transmit_calls == 0);
+	ASSERT(stats.transmit_pending_high_water == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Transmit_Threaded)
+{
+	const size_t COUNT = 1000;
+	std::vector<uint8_t> expected;
+	for (size_t i = 0; i < COUNT; i++)
+		expected.insert(expected.end(), { 'a', 'b' });
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetServer(1, "test-server-b", "test-service-b");
+	SIM_WIFI_SetServer(2, "test-server-c", "test-service-c");
+	for (size_t link_id = 0; link_id < 3; link_id++)
+		SIM_WIFI_TransmitBytes(link_id, expected.data(), expected.size());
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	RLM3_WIFI_ServerConnect(1, "test-server-b", "test-service-b");
+	RLM3_WIFI_ServerConnect(2, "test-server-c", "test-service-c");
+
+	// Links 0 and 1 each get their own thread; link 2 is shared by two threads sending identical data.
+	auto transmit = [](size_t link_id, size_t count) {
+		for (size_t i = 0; i < count; i++)
+			ASSERT(RLM3_WIFI_Transmit(link_id, (const uint8_t*)"ab", 2));
+	};
+	std::thread threads[] = {
+		std::thread(transmit, 0, COUNT),
+		std::thread(transmit, 1, COUNT),
+		std::thread(transmit, 2, COUNT / 2),
+		std::thread(transmit, 2, COUNT / 2),
+	};
+	for (auto& thread : threads)
+		thread.join();
+
+	for (size_t link_id = 0; link_id < 3; link_id++)
+	{
+		SIM_WIFI_Stats stats;
+		SIM_WIFI_GetStats(link_id, &stats);
+		ASSERT(stats.transmit_calls == COUNT);
+		ASSERT(stats.transmit_bytes == 2 * COUNT);
+	}
+	ASSERT(!RLM3_WIFI_Transmit(2, (const uint8_t*)"ab", 2));
+}
+
+TEST_CASE(RLM3_WIFI_Faults_TransmitReject)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_SetServer(1, "test-server-b", "test-service-b");
+	SIM_WIFI_Transmit(0, "abc");
+	SIM_WIFI_Transmit(1, "abc");
+	SIM_WIFI_Faults faults = {};
+	faults.transmit_reject = 1.0;
+	SIM_WIFI_SetLinkFaults(0, &faults);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	RLM3_WIFI_ServerConnect(1, "test-server-b", "test-service-b");
+
+	ASSERT(!RLM3_WIFI_Transmit(0, (const uint8_t*)"abc", 3));
+	ASSERT(RLM3_WIFI_Transmit(1, (const uint8_t*)"abc", 3));
+	SIM_WIFI_SetLinkFaults(0, nullptr);
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"abc", 3));
+
+	SIM_WIFI_Stats stats;
+	SIM_WIFI_GetStats(0, &stats);
+	ASSERT(stats.fault_count == 1);
+}
+
+TEST_CASE(RLM3_WIFI_Faults_FragmentDeterministic)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Faults faults = {};
+	faults.receive_fragment = 1.0;
+	SIM_WIFI_SetFaults(&faults);
+	SIM_WIFI_SetFaultSeed(42);
+	SIM_WIFI_Receive(0, "abcdefghijklmnopqrstuvwxyz");
+	SIM_WIFI_SetFaultSeed(42);
+	SIM_WIFI_Receive(0, "abcdefghijklmnopqrstuvwxyz");
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	while (g_link_recv_info[0].count < 26)
+		RLM3_Take();
+	size_t first_blocks = g_link_recv_info[0].blocks;
+	while (g_link_recv_info[0].count < 52)
+		RLM3_Take();
+	ASSERT(first_blocks > 1);
+	ASSERT(g_link_recv_info[0].blocks == 2 * first_blocks);
+	ASSERT(std::strncmp(g_link_recv_info[0].buffer, "abcdefghijklmnopqrstuvwxyzabcdef", 32) == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Faults_Disconnect)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Receive(0, "abc");
+	SIM_WIFI_Receive(0, "def");
+	SIM_WIFI_Faults faults = {};
+	faults.disconnect = 1.0;
+	SIM_WIFI_SetFaults(&faults);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(g_link_recv_info[0].count == 6);
+	ASSERT(!RLM3_WIFI_IsServerConnected(0));
+	RLM3_WIFI_ServerDisconnect(0);
+}
+
+TEST_CASE(RLM3_WIFI_Faults_NetworkDrop)
+{
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(0, "test-server", "test-service");
+	SIM_WIFI_Transmit(0, "abc");
+	SIM_WIFI_Faults faults = {};
+	faults.network_drop = 1.0;
+	SIM_WIFI_SetFaults(&faults);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_NetworkConnect("test-ssid", "test-password");
+	RLM3_WIFI_ServerConnect(0, "test-server", "test-service");
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"abc", 3));
+
+	while (!g_network_disconnect_called)
+		RLM3_Take();
+	ASSERT(!RLM3_WIFI_IsNetworkConnected());
+	ASSERT(!RLM3_WIFI_IsServerConnected(0));
+	RLM3_WIFI_NetworkDisconnect();
+}
+
+TEST_CASE(RLM3_WIFI_LocalNetwork_HappyCase)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	SIM_WIFI_Connect(0);
+	SIM_WIFI_Receive(0, "abc");
+	SIM_WIFI_Connect(1);
+	SIM_WIFI_Transmit(1, "hello world");
+	SIM_WIFI_Disconnect(1);
+	SIM_WIFI_Disconnect(0);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	ASSERT(!g_network_connect_called);
+	RLM3_Take();
+	ASSERT(g_network_connect_called);
+	ASSERT(g_network_connect_link_id == 0);
+	g_network_connect_called = false;
+	ASSERT(g_link_recv_info[0].count == 0);
+	RLM3_Take();
+	ASSERT(g_link_recv_info[0].count == 3);
+	ASSERT(!g_network_connect_called);
+	RLM3_Take();
+	ASSERT(g_network_connect_called);
+	ASSERT(g_network_connect_link_id == 1);
+	RLM3_WIFI_Transmit(1, (const uint8_t*)"hello world", 11);
+	ASSERT(!g_network_disconnect_called);
+	RLM3_Take();
+	ASSERT(g_network_disconnect_called);
+	ASSERT(g_network_disconnect_link_id == 1);
+	g_network_disconnect_called = false;
+	RLM3_Take();
+	ASSERT(g_network_disconnect_called);
+	ASSERT(g_network_disconnect_link_id == 0);
+}
+
+TEST_CASE(RLM3_WIFI_LocalNetwork_MaxClients)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 1, "test-ip-address", "test-service");
+	SIM_WIFI_Connect(0);
+	SIM_WIFI_Connect(1);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 1, "test-ip-address", "test-service");
+	RLM3_Take();
+	ASSERT_ASSERTS(RLM3_Take());
+}
+
+TEST_CASE(RLM3_WIFI_Churn_HappyCase)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	SIM_WIFI_Churn churn = { 20, 5, 20, 4 };
+	SIM_WIFI_StartChurn(&churn);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	while (SIM_WIFI_IsChurnActive())
+	{
+		RLM3_Take();
+		for (size_t link_id = 0; link_id < RLM3_WIFI_LINK_COUNT; link_id++)
+		{
+			if (g_link_recv_info[link_id].count < 4)
+				continue;
+			g_link_recv_info[link_id].count = 0;
+			if (RLM3_WIFI_IsServerConnected(link_id))
+				ASSERT(RLM3_WIFI_Transmit(link_id, (const uint8_t*)"ok", 2));
+		}
+	}
+
+	SIM_WIFI_ChurnStats stats;
+	SIM_WIFI_GetChurnStats(&stats);
+	ASSERT(stats.sessions == 20);
+	ASSERT(stats.peak_clients == 2);
+	ASSERT(stats.deferred_connects > 0);
+	ASSERT(stats.responses == 20);
+	ASSERT(stats.response_max == 0);
+	ASSERT(stats.link_sessions[0] + stats.link_sessions[1] == 20);
+	ASSERT(stats.link_sessions[2] == 0);
+}
+
+TEST_CASE(RLM3_WIFI_Churn_LinksFull)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 10, "test-ip-address", "test-service");
+	SIM_WIFI_Churn churn = { 20, 1, 50, 0 };
+	SIM_WIFI_StartChurn(&churn);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 10, "test-ip-address", "test-service");
+	while (SIM_WIFI_IsChurnActive())
+		RLM3_Delay(10);
+
+	SIM_WIFI_ChurnStats stats;
+	SIM_WIFI_GetChurnStats(&stats);
+	ASSERT(stats.sessions == 20);
+	ASSERT(stats.peak_clients == RLM3_WIFI_LINK_COUNT);
+	ASSERT(stats.deferred_connects > 0);
+}
+
+TEST_CASE(RLM3_WIFI_Churn_LinkModel)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	SIM_WIFI_SetLinkModel(0, 0, 5, 0, 0);
+	SIM_WIFI_Churn churn = { 1, 1, 1000, 4 };
+	SIM_WIFI_StartChurn(&churn);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	while (!g_network_connect_called)
+		RLM3_Take();
+	RLM3_Time connect_time = RLM3_GetCurrentTime();
+	while (g_link_recv_info[0].count < 4)
+		RLM3_Take();
+	ASSERT(RLM3_GetCurrentTime() - connect_time == 5);
+}
+
+TEST_CASE(RLM3_WIFI_Churn_Snapshot)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	SIM_WIFI_Churn churn = { 1, 1, 100, 0 };
+	SIM_WIFI_StartChurn(&churn);
+
+	RLM3_WIFI_Init();
+	RLM3_WIFI_LocalNetworkEnable("test-ssid", "test-password", 2, "test-ip-address", "test-service");
+	while (!g_network_connect_called)
+		RLM3_Take();
+	SIM_WIFI_Instance* snapshot = SIM_WIFI_Snapshot();
+	RLM3_Delay(1000);
+	ASSERT(!SIM_WIFI_IsChurnActive());
+
+	// The restored client connected just now, so an immediate answer has no response time.
+	SIM_WIFI_Restore(snapshot);
+	ASSERT(RLM3_WIFI_IsServerConnected(0));
+	ASSERT(RLM3_WIFI_Transmit(0, (const uint8_t*)"ok", 2));
+	SIM_WIFI_ChurnStats stats;
+	SIM_WIFI_GetChurnStats(&stats);
+	ASSERT(stats.responses == 1);
+	ASSERT(stats.response_max == 0);
+	SIM_WIFI_DestroyInstance(snapshot);
+}
+
+TEST_CASE(RLM3_WIFI_AT_ServerSession)
+{
+	SIM_WIFI_SetVersion(0x01070400, 0x03000400);
+	SIM_WIFI_SetNetwork("test-ssid", "test-password");
+	SIM_WIFI_SetServer(2, "test-server", "80");
+	SIM_WIFI_Transmit(2, "hello");
+
+	SIM_WIFI_AT_Start();
+	ExpectAT("\r\nready\r\n");
+	SendAT("ATE0\r\n");
+	ExpectAT("ATE0\r\n\r\nOK\r\n");
+	SendAT("AT+GMR\r\n");
+	ExpectAT("AT version:1.7.4.0\r\nSDK version:3.0.4.0\r\n\r\nOK\r\n");
+	SendAT("AT+CIPMUX=1\r\nAT+CWJAP=\"test-ssid\",\"test-password\"\r\n");
+	ExpectAT("\r\nOK\r\nWIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+	SendAT("AT+CIPSTART=2,\"TCP\",\"test-server\",80\r\n");
+	ExpectAT("2,CONNECT\r\n\r\nOK\r\n");
+	SIM_WIFI_Receive(2, "world");
+	ExpectAT("\r\n+IPD,2,5:world");
+	SendAT("AT+CIPSEND=2,5\r\n");
+	ExpectAT("\r\nOK\r\n> ");
+	SendAT("hel");
+	SendAT("lo");
+	ExpectAT("\r\nRecv 5 bytes\r\n\r\nSEND OK\r\n");
+	SendAT("AT+CIPSEND=2,1\r\nx");
+	ExpectAT("\r\nSEND FAIL\r\n");
+	SendAT("AT+CIPCLOSE=2\r\n");
+	ExpectAT("2,CLOSED\r\n\r\nOK\r\n");
+	SendAT("AT+CIPSEND=2,1\r\n");
+	ExpectAT("link is not valid\r\n\r\nERROR\r\n");
+	SendAT("AT+BOGUS\r\n");
+	ExpectAT("\r\nERROR\r\n");
+	SIM_WIFI_AT_Stop();
+	ASSERT(g_link_recv_info[2].count == 0);
+}
+
+TEST_CASE(RLM3_WIFI_AT_LocalNetwork)
+{
+	SIM_WIFI_SetLocalNetwork("test-ssid", "test-password", 2, "192.168.4.1", "23");
+
+	SIM_WIFI_AT_Start();
+	ExpectAT("ready\r\n");
+	SendAT("ATE0\r\nAT+CWMODE=2\r\nAT+CIPMUX=1\r\n");
+	SendAT("AT+CWSAP=\"test-ssid\",\"test-password\",5,3,2\r\nAT+CIPAP=\"192.168.4.1\"\r\nAT+CIPSERVER=1,23\r\n");
+	ExpectAT("\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n\r\nOK\r\n");
+	SIM_WIFI_Connect(0);
+	SIM_WIFI_Receive(0, "abc");
+	SIM_WIFI_Disconnect(0);
+	ExpectAT("0,CONNECT\r\n");
+	ExpectAT("\r\n+IPD,0,3:abc");
+	ExpectAT("0,CLOSED\r\n");
+	SendAT("AT+CIPSERVER=0\r\n");
+	ExpectAT("\r\nOK\r\n");
+	SIM_WIFI_AT_Stop();
 }
 
 TEST_SETUP(WIFI_TEST_SETUP)
@@ -472,8 +2039,12 @@ TEST_SETUP(WIFI_TEST_SETUP)
 	for (auto& i : g_link_recv_info)
 	{
 		i.count = 0;
+		i.blocks = 0;
 	}
 	g_network_connect_called = false;
 	g_network_disconnect_called = false;
+	g_transmit_complete_count = 0;
+	g_receive_ready_count = 0;
+	g_at_received.clear();
 	g_task = RLM3_GetCurrentTask();
 }